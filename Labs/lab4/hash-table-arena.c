@@ -0,0 +1,70 @@
+#include "hash-table-arena.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Small, since a concurrent table keeps thousands of mostly empty arenas */
+#define ARENA_MIN_CHUNK 64
+
+static unsigned get_chunk(uint64_t offset)
+{
+	return 63 - __builtin_clzll(offset / ARENA_MIN_CHUNK + 1);
+}
+
+static uint64_t get_chunk_start(unsigned chunk)
+{
+	return (uint64_t) ARENA_MIN_CHUNK * ((1ull << chunk) - 1);
+}
+
+void hash_table_arena_init(struct hash_table_arena *arena)
+{
+	memset(arena, 0, sizeof(*arena));
+}
+
+uint32_t hash_table_arena_add(struct hash_table_arena *arena,
+                              const char *key,
+                              uint32_t length)
+{
+	/* A key never straddles two chunks, the rest of a chunk it does not
+	   fit in is skipped */
+	uint64_t needed = (uint64_t) length + 1;
+	unsigned chunk = get_chunk(arena->size);
+	while (arena->size + needed > get_chunk_start(chunk + 1)) {
+		++chunk;
+		arena->size = get_chunk_start(chunk);
+	}
+	/* Offsets past 32 bits are out of room just like a failed malloc, and
+	   neither may go unchecked in a build without asserts */
+	if (chunk >= HASH_TABLE_ARENA_CHUNKS || arena->size + needed > UINT32_MAX) {
+		exit(ENOMEM);
+	}
+
+	if (arena->chunks[chunk] == NULL) {
+		size_t bytes = (size_t) ARENA_MIN_CHUNK << chunk;
+		arena->chunks[chunk] = malloc(bytes);
+		if (arena->chunks[chunk] == NULL) {
+			exit(ENOMEM);
+		}
+		arena->reserved += bytes;
+	}
+	uint32_t offset = arena->size;
+	memcpy(arena->chunks[chunk] + (offset - get_chunk_start(chunk)), key, needed);
+	arena->size += needed;
+	return offset;
+}
+
+const char *hash_table_arena_get(const struct hash_table_arena *arena,
+                                 uint32_t offset)
+{
+	unsigned chunk = get_chunk(offset);
+	return arena->chunks[chunk] + (offset - get_chunk_start(chunk));
+}
+
+void hash_table_arena_destroy(struct hash_table_arena *arena)
+{
+	for (unsigned i = 0; i < HASH_TABLE_ARENA_CHUNKS; ++i) {
+		free(arena->chunks[i]);
+	}
+	memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Enough chunks to cover every 32-bit offset */
+#define HASH_TABLE_ARENA_CHUNKS 26
+
+/* Holds copies of keys back to back, each with its terminator, so tables can
+   own their keys and nodes only need a 32-bit offset and a length. Chunks
+   double in size and are never moved or freed until the arena is destroyed,
+   which keeps a key's bytes in place for unlocked readers. Like a slab, an
+   arena is not thread safe; concurrent tables keep one per lock. Running
+   out of memory or of offsets exits with ENOMEM. */
+struct hash_table_arena {
+	/* Chunk k holds offsets [64 * (2^k - 1), 64 * (2^(k + 1) - 1)) */
+	char *chunks[HASH_TABLE_ARENA_CHUNKS];
+	/* Offset the next key goes at */
+	uint64_t size;
+	/* Bytes allocated for chunks */
+	size_t reserved;
+};
+
+void hash_table_arena_init(struct hash_table_arena *arena);
+uint32_t hash_table_arena_add(struct hash_table_arena *arena,
+                              const char *key,
+                              uint32_t length);
+const char *hash_table_arena_get(const struct hash_table_arena *arena,
+                                 uint32_t offset);
+void hash_table_arena_destroy(struct hash_table_arena *arena);
@@ -0,0 +1,37 @@
+/* Declares a base table named HASH_TABLE_NAME that stores HASH_TABLE_VALUE
+   values inline in its nodes. Define both, then include this, once per
+   instantiation; both are undefined again at the end. hash-table-base.h is
+   the uint32_t instantiation. */
+
+struct HASH_TABLE_NAME;
+struct HASH_TABLE_NAME *HASH_TABLE_FN(create)();
+struct HASH_TABLE_NAME *HASH_TABLE_FN(create_with_options)(const struct hash_table_options *options);
+void HASH_TABLE_FN(add_entry)(struct HASH_TABLE_NAME *hash_table,
+                              const char *key,
+                              HASH_TABLE_VALUE value);
+bool HASH_TABLE_FN(contains)(struct HASH_TABLE_NAME *hash_table,
+                             const char *key);
+HASH_TABLE_VALUE HASH_TABLE_FN(get_value)(struct HASH_TABLE_NAME *hash_table,
+                                          const char* key);
+size_t HASH_TABLE_FN(allocations)(struct HASH_TABLE_NAME *hash_table);
+size_t HASH_TABLE_FN(key_bytes)(struct HASH_TABLE_NAME *hash_table);
+void HASH_TABLE_FN(chain_stats)(struct HASH_TABLE_NAME *hash_table,
+                                struct hash_table_chain_stats *stats);
+void HASH_TABLE_FN(for_each)(struct HASH_TABLE_NAME *hash_table,
+                             void (*visit)(const char *key, HASH_TABLE_VALUE value, void *arg),
+                             void *arg);
+void HASH_TABLE_FN(destroy)(struct HASH_TABLE_NAME *hash_table);
+
+/* A table saved to a file and mapped back read-only, see README.md */
+struct HASH_TABLE_FN(snapshot);
+int HASH_TABLE_FN(save)(struct HASH_TABLE_NAME *hash_table, const char *path);
+struct HASH_TABLE_FN(snapshot) *HASH_TABLE_FN(load)(const char *path);
+bool HASH_TABLE_FN(snapshot_contains)(struct HASH_TABLE_FN(snapshot) *snapshot,
+                                      const char *key);
+HASH_TABLE_VALUE HASH_TABLE_FN(snapshot_get_value)(struct HASH_TABLE_FN(snapshot) *snapshot,
+                                                   const char *key);
+size_t HASH_TABLE_FN(snapshot_size)(struct HASH_TABLE_FN(snapshot) *snapshot);
+void HASH_TABLE_FN(unload)(struct HASH_TABLE_FN(snapshot) *snapshot);
+
+#undef HASH_TABLE_NAME
+#undef HASH_TABLE_VALUE
@@ -0,0 +1,544 @@
+/* The base table, for a value type chosen at compile time. A source file
+   instantiates it by defining HASH_TABLE_NAME (the prefix of the table's
+   struct and functions) and HASH_TABLE_VALUE, then including this after the
+   declarations from hash-table-base-decl.h. Each source file may only hold
+   one instantiation, since the helpers below are static. */
+
+#include "hash-table-arena.h"
+#include "hash-table-slab.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct list_entry {
+	/* The caller's key, or with own_keys, where the table's copy is */
+	union {
+		const char *key;
+		struct {
+			uint32_t offset;
+			uint32_t length;
+		} owned;
+	};
+	/* The full hash of key, so most mismatches skip the strcmp */
+	uint32_t hash;
+	HASH_TABLE_VALUE value;
+	SLIST_ENTRY(list_entry) pointers;
+};
+
+SLIST_HEAD(list_head, list_entry);
+
+struct hash_table_entry {
+	struct list_head list_head;
+};
+
+struct HASH_TABLE_NAME {
+	struct hash_table_entry *entries;
+	/* Always a power of two */
+	size_t capacity;
+	size_t size;
+	struct hash_table_options options;
+	struct hash_table_slab slab;
+	/* Only used with own_keys */
+	struct hash_table_arena keys;
+};
+
+static struct hash_table_entry *create_entries(size_t capacity)
+{
+	struct hash_table_entry *entries = calloc(capacity, sizeof(struct hash_table_entry));
+	assert(entries != NULL);
+	for (size_t i = 0; i < capacity; ++i) {
+		SLIST_INIT(&entries[i].list_head);
+	}
+	return entries;
+}
+
+struct HASH_TABLE_NAME *HASH_TABLE_FN(create_with_options)(const struct hash_table_options *options)
+{
+	struct HASH_TABLE_NAME *hash_table = calloc(1, sizeof(struct HASH_TABLE_NAME));
+	assert(hash_table != NULL);
+	hash_table->entries = create_entries(HASH_TABLE_CAPACITY);
+	hash_table->capacity = HASH_TABLE_CAPACITY;
+	hash_table->options = *options;
+	hash_table_slab_init(&hash_table->slab, sizeof(struct list_entry), options->slab);
+	hash_table_arena_init(&hash_table->keys);
+	return hash_table;
+}
+
+struct HASH_TABLE_NAME *HASH_TABLE_FN(create)()
+{
+	return HASH_TABLE_FN(create_with_options)(&hash_table_default_options);
+}
+
+static struct hash_table_entry *get_hash_table_entry(struct HASH_TABLE_NAME *hash_table,
+                                                     uint32_t hash)
+{
+	uint32_t index = hash & (hash_table->capacity - 1);
+	struct hash_table_entry *entry = &hash_table->entries[index];
+	return entry;
+}
+
+/* Doubles the number of buckets and relinks every node into its new chain */
+static void grow(struct HASH_TABLE_NAME *hash_table)
+{
+	struct hash_table_entry *old_entries = hash_table->entries;
+	size_t old_capacity = hash_table->capacity;
+	hash_table->entries = create_entries(old_capacity * 2);
+	hash_table->capacity = old_capacity * 2;
+
+	for (size_t i = 0; i < old_capacity; ++i) {
+		struct list_head *list_head = &old_entries[i].list_head;
+		struct list_entry *list_entry = NULL;
+		while (!SLIST_EMPTY(list_head)) {
+			list_entry = SLIST_FIRST(list_head);
+			SLIST_REMOVE_HEAD(list_head, pointers);
+			struct hash_table_entry *entry = get_hash_table_entry(hash_table, list_entry->hash);
+			SLIST_INSERT_HEAD(&entry->list_head, list_entry, pointers);
+		}
+	}
+	free(old_entries);
+}
+
+static const char *get_key(struct HASH_TABLE_NAME *hash_table,
+                           struct list_entry *list_entry)
+{
+	if (hash_table->options.own_keys) {
+		return hash_table_arena_get(&hash_table->keys, list_entry->owned.offset);
+	}
+	return list_entry->key;
+}
+
+static struct list_entry *get_list_entry(struct HASH_TABLE_NAME *hash_table,
+                                         const char *key,
+                                         uint32_t hash,
+                                         struct list_head *list_head)
+{
+	assert(key != NULL);
+
+	struct list_entry *entry = NULL;
+	bool check_hash = !hash_table->options.skip_hash_check;
+	
+	SLIST_FOREACH(entry, list_head, pointers) {
+	  if ((!check_hash || entry->hash == hash)
+	      && strcmp(get_key(hash_table, entry), key) == 0) {
+	    return entry;
+	  }
+	}
+	return NULL;
+}
+
+bool HASH_TABLE_FN(contains)(struct HASH_TABLE_NAME *hash_table,
+                             const char *key)
+{
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, hash);
+	struct list_head *list_head = &hash_table_entry->list_head;
+	struct list_entry *list_entry = get_list_entry(hash_table, key, hash, list_head);
+	return list_entry != NULL;
+}
+
+void HASH_TABLE_FN(add_entry)(struct HASH_TABLE_NAME *hash_table,
+                              const char *key,
+                              HASH_TABLE_VALUE value)
+{
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, hash);
+	struct list_head *list_head = &hash_table_entry->list_head;
+	struct list_entry *list_entry = get_list_entry(hash_table, key, hash, list_head);
+
+	/* Update the value if it already exists */
+	if (list_entry != NULL) {
+		list_entry->value = value;
+		return;
+	}
+
+	list_entry = hash_table_slab_alloc(&hash_table->slab);
+	if (hash_table->options.own_keys) {
+		list_entry->owned.length = strlen(key);
+		list_entry->owned.offset = hash_table_arena_add(&hash_table->keys, key,
+		                                                list_entry->owned.length);
+	}
+	else {
+		list_entry->key = key;
+	}
+	list_entry->hash = hash;
+	list_entry->value = value;
+	SLIST_INSERT_HEAD(list_head, list_entry, pointers);
+
+	++hash_table->size;
+	double max_load_factor = hash_table->options.max_load_factor;
+	if (max_load_factor > 0 && hash_table->size > hash_table->capacity * max_load_factor) {
+		grow(hash_table);
+	}
+}
+
+HASH_TABLE_VALUE HASH_TABLE_FN(get_value)(struct HASH_TABLE_NAME *hash_table,
+                                          const char *key)
+{
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, hash);
+	struct list_head *list_head = &hash_table_entry->list_head;
+	struct list_entry *list_entry = get_list_entry(hash_table, key, hash, list_head);
+	assert(list_entry != NULL);
+	return list_entry->value;
+}
+
+size_t HASH_TABLE_FN(allocations)(struct HASH_TABLE_NAME *hash_table)
+{
+	return hash_table->slab.allocations;
+}
+
+size_t HASH_TABLE_FN(key_bytes)(struct HASH_TABLE_NAME *hash_table)
+{
+	return hash_table->keys.reserved;
+}
+
+void HASH_TABLE_FN(chain_stats)(struct HASH_TABLE_NAME *hash_table,
+                                struct hash_table_chain_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->buckets = hash_table->capacity;
+	for (size_t i = 0; i < hash_table->capacity; ++i) {
+		struct list_entry *list_entry = NULL;
+		size_t length = 0;
+		SLIST_FOREACH(list_entry, &hash_table->entries[i].list_head, pointers) {
+			++length;
+		}
+		if (length > 0) {
+			++stats->used_buckets;
+		}
+		if (length > stats->max_length) {
+			stats->max_length = length;
+		}
+		stats->entries += length;
+	}
+}
+
+/* Calls visit on every entry, in bucket order. visit must not add to the
+   table, which could grow it under the walk. */
+void HASH_TABLE_FN(for_each)(struct HASH_TABLE_NAME *hash_table,
+                             void (*visit)(const char *key, HASH_TABLE_VALUE value, void *arg),
+                             void *arg)
+{
+	for (size_t i = 0; i < hash_table->capacity; ++i) {
+		struct list_entry *list_entry = NULL;
+		SLIST_FOREACH(list_entry, &hash_table->entries[i].list_head, pointers) {
+			visit(get_key(hash_table, list_entry), list_entry->value, arg);
+		}
+	}
+}
+
+/* Snapshots hold no pointers, only offsets from the start of the file, and
+   each section starts on its own cache line:
+
+   - a snapshot_header
+   - capacity + 1 bucket offsets, bucket i holding records [buckets[i],
+     buckets[i + 1])
+   - size snapshot_records, grouped by bucket
+   - every key, NUL terminated so lookups can strcmp them in place */
+#define SNAPSHOT_MAGIC "HTSNAP1"
+#define SNAPSHOT_ALIGN 64
+
+struct snapshot_header {
+	char magic[8];
+	/* sizeof(HASH_TABLE_VALUE) of the saving table, so a snapshot is not
+	   loaded as some other instantiation */
+	uint32_t value_bytes;
+	uint32_t hash_function;
+	/* Always a power of two */
+	uint64_t capacity;
+	uint64_t size;
+	uint64_t buckets_offset;
+	uint64_t records_offset;
+	uint64_t keys_offset;
+	uint64_t file_bytes;
+};
+
+struct snapshot_record {
+	uint64_t key_offset;
+	uint32_t hash;
+	HASH_TABLE_VALUE value;
+};
+
+struct HASH_TABLE_FN(snapshot) {
+	void *image;
+	size_t image_bytes;
+	const uint64_t *buckets;
+	const struct snapshot_record *records;
+	const char *keys;
+	uint64_t capacity;
+	uint64_t size;
+	enum hash_table_hash_function hash_function;
+};
+
+static uint64_t snapshot_align(uint64_t offset)
+{
+	return (offset + SNAPSHOT_ALIGN - 1) & ~(uint64_t) (SNAPSHOT_ALIGN - 1);
+}
+
+/* Writes the table to path in the snapshot layout, with about one bucket per
+   entry whatever the table's own capacity. Returns 0, or the errno of the
+   failed write. */
+int HASH_TABLE_FN(save)(struct HASH_TABLE_NAME *hash_table, const char *path)
+{
+	uint64_t capacity = 1;
+	while (capacity < hash_table->size) {
+		capacity *= 2;
+	}
+	uint64_t key_bytes = 0;
+	for (size_t i = 0; i < hash_table->capacity; ++i) {
+		struct list_entry *list_entry = NULL;
+		SLIST_FOREACH(list_entry, &hash_table->entries[i].list_head, pointers) {
+			key_bytes += strlen(get_key(hash_table, list_entry)) + 1;
+		}
+	}
+
+	struct snapshot_header header = {
+		.magic = SNAPSHOT_MAGIC,
+		.value_bytes = sizeof(HASH_TABLE_VALUE),
+		.hash_function = hash_table->options.hash_function,
+		.capacity = capacity,
+		.size = hash_table->size,
+	};
+	header.buckets_offset = snapshot_align(sizeof(header));
+	header.records_offset = snapshot_align(header.buckets_offset +
+	                                       (capacity + 1) * sizeof(uint64_t));
+	header.keys_offset = snapshot_align(header.records_offset +
+	                                    header.size * sizeof(struct snapshot_record));
+	header.file_bytes = header.keys_offset + key_bytes;
+
+	char *image = calloc(1, header.file_bytes);
+	assert(image != NULL);
+	memcpy(image, &header, sizeof(header));
+	uint64_t *buckets = (uint64_t *) (image + header.buckets_offset);
+	struct snapshot_record *records = (struct snapshot_record *) (image + header.records_offset);
+	char *keys = image + header.keys_offset;
+
+	/* Count each bucket's records after its offset, so the running sum
+	   leaves buckets[i] at where bucket i starts. Placing a record then
+	   moves its bucket's offset on, to where the next bucket starts. */
+	for (size_t i = 0; i < hash_table->capacity; ++i) {
+		struct list_entry *list_entry = NULL;
+		SLIST_FOREACH(list_entry, &hash_table->entries[i].list_head, pointers) {
+			++buckets[(list_entry->hash & (capacity - 1)) + 1];
+		}
+	}
+	for (uint64_t i = 1; i <= capacity; ++i) {
+		buckets[i] += buckets[i - 1];
+	}
+	for (size_t i = 0; i < hash_table->capacity; ++i) {
+		struct list_entry *list_entry = NULL;
+		SLIST_FOREACH(list_entry, &hash_table->entries[i].list_head, pointers) {
+			struct snapshot_record *record =
+				&records[buckets[list_entry->hash & (capacity - 1)]++];
+			/* Holds the key itself until the keys are laid out below */
+			record->key_offset = (uintptr_t) get_key(hash_table, list_entry);
+			record->hash = list_entry->hash;
+			record->value = list_entry->value;
+		}
+	}
+	/* Keys go in record order, so a bucket's keys sit together */
+	uint64_t key_offset = 0;
+	for (uint64_t i = 0; i < header.size; ++i) {
+		const char *key = (const char *) (uintptr_t) records[i].key_offset;
+		size_t length = strlen(key) + 1;
+		memcpy(keys + key_offset, key, length);
+		records[i].key_offset = key_offset;
+		key_offset += length;
+	}
+	for (uint64_t i = capacity; i > 0; --i) {
+		buckets[i] = buckets[i - 1];
+	}
+	buckets[0] = 0;
+
+	int err = 0;
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		err = errno;
+	}
+	else {
+		if (fwrite(image, 1, header.file_bytes, file) != header.file_bytes) {
+			err = errno;
+		}
+		if (fclose(file) != 0 && err == 0) {
+			err = errno;
+		}
+	}
+	free(image);
+	return err;
+}
+
+/* Checks that every offset a lookup follows stays inside the image, so a
+   corrupt or truncated file fails to load instead of reading out of bounds.
+   The bucket offsets and records are read once. The keys are not: a keys
+   section that ends in a NUL terminates every key starting inside it. */
+static bool snapshot_is_valid(const char *image, size_t image_bytes)
+{
+	const struct snapshot_header *header = (const struct snapshot_header *) image;
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+	    || header->value_bytes != sizeof(HASH_TABLE_VALUE)
+	    || header->hash_function >= HASH_TABLE_HASH_COUNT
+	    || header->capacity == 0
+	    || (header->capacity & (header->capacity - 1)) != 0
+	    || header->file_bytes != image_bytes) {
+		return false;
+	}
+	/* In this order, so no subtraction below wraps and no section overlaps
+	   the one before it. Written without multiplying, which could. */
+	if (header->buckets_offset % SNAPSHOT_ALIGN != 0
+	    || header->records_offset % SNAPSHOT_ALIGN != 0
+	    || header->keys_offset % SNAPSHOT_ALIGN != 0
+	    || header->buckets_offset < sizeof(struct snapshot_header)
+	    || header->records_offset < header->buckets_offset
+	    || header->keys_offset < header->records_offset
+	    || header->keys_offset > image_bytes
+	    || (header->records_offset - header->buckets_offset) / sizeof(uint64_t) <= header->capacity
+	    || (header->keys_offset - header->records_offset) / sizeof(struct snapshot_record) < header->size) {
+		return false;
+	}
+
+	uint64_t key_bytes = image_bytes - header->keys_offset;
+	if (header->size > 0 && (key_bytes == 0 || image[image_bytes - 1] != 0)) {
+		return false;
+	}
+	const uint64_t *buckets = (const uint64_t *) (image + header->buckets_offset);
+	if (buckets[0] != 0 || buckets[header->capacity] != header->size) {
+		return false;
+	}
+	for (uint64_t i = 0; i < header->capacity; ++i) {
+		if (buckets[i] > buckets[i + 1]) {
+			return false;
+		}
+	}
+	const struct snapshot_record *records =
+		(const struct snapshot_record *) (image + header->records_offset);
+	for (uint64_t i = 0; i < header->size; ++i) {
+		if (records[i].key_offset >= key_bytes) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Maps a snapshot read-only and checks its offsets, without reading its
+   keys, so lookups start soon and fault the key pages in as they touch them.
+   Returns NULL with errno set if the file cannot be opened, or EINVAL if it
+   is not a well formed snapshot of this value type. */
+struct HASH_TABLE_FN(snapshot) *HASH_TABLE_FN(load)(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	size_t image_bytes = file_stat.st_size;
+	if (image_bytes < sizeof(struct snapshot_header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	void *image = mmap(NULL, image_bytes, PROT_READ, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	if (image == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+
+	if (!snapshot_is_valid(image, image_bytes)) {
+		munmap(image, image_bytes);
+		errno = EINVAL;
+		return NULL;
+	}
+	const struct snapshot_header *header = image;
+
+	struct HASH_TABLE_FN(snapshot) *snapshot = malloc(sizeof(*snapshot));
+	assert(snapshot != NULL);
+	snapshot->image = image;
+	snapshot->image_bytes = image_bytes;
+	snapshot->buckets = (const uint64_t *) ((const char *) image + header->buckets_offset);
+	snapshot->records = (const struct snapshot_record *) ((const char *) image + header->records_offset);
+	snapshot->keys = (const char *) image + header->keys_offset;
+	snapshot->capacity = header->capacity;
+	snapshot->size = header->size;
+	snapshot->hash_function = header->hash_function;
+	return snapshot;
+}
+
+static const struct snapshot_record *get_snapshot_record(struct HASH_TABLE_FN(snapshot) *snapshot,
+                                                         const char *key)
+{
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(snapshot->hash_function, key);
+	uint64_t bucket = hash & (snapshot->capacity - 1);
+	for (uint64_t i = snapshot->buckets[bucket]; i < snapshot->buckets[bucket + 1]; ++i) {
+		const struct snapshot_record *record = &snapshot->records[i];
+		if (record->hash == hash && strcmp(snapshot->keys + record->key_offset, key) == 0) {
+			return record;
+		}
+	}
+	return NULL;
+}
+
+bool HASH_TABLE_FN(snapshot_contains)(struct HASH_TABLE_FN(snapshot) *snapshot,
+                                      const char *key)
+{
+	return get_snapshot_record(snapshot, key) != NULL;
+}
+
+HASH_TABLE_VALUE HASH_TABLE_FN(snapshot_get_value)(struct HASH_TABLE_FN(snapshot) *snapshot,
+                                                   const char *key)
+{
+	const struct snapshot_record *record = get_snapshot_record(snapshot, key);
+	assert(record != NULL);
+	return record->value;
+}
+
+size_t HASH_TABLE_FN(snapshot_size)(struct HASH_TABLE_FN(snapshot) *snapshot)
+{
+	return snapshot->size;
+}
+
+void HASH_TABLE_FN(unload)(struct HASH_TABLE_FN(snapshot) *snapshot)
+{
+	munmap(snapshot->image, snapshot->image_bytes);
+	free(snapshot);
+}
+
+void HASH_TABLE_FN(destroy)(struct HASH_TABLE_NAME *hash_table)
+{
+	/* Slab nodes are released together with their chunks */
+	for (size_t i = 0; i < hash_table->capacity && !hash_table->options.slab; ++i) {
+		struct hash_table_entry *entry = &hash_table->entries[i];
+		struct list_head *list_head = &entry->list_head;
+		struct list_entry *list_entry = NULL;
+		while (!SLIST_EMPTY(list_head)) {
+			list_entry = SLIST_FIRST(list_head);
+			SLIST_REMOVE_HEAD(list_head, pointers);
+			free(list_entry);
+		}
+	}
+	hash_table_slab_destroy(&hash_table->slab);
+	hash_table_arena_destroy(&hash_table->keys);
+	free(hash_table->entries);
+	free(hash_table);
+}
+
+#undef HASH_TABLE_NAME
+#undef HASH_TABLE_VALUE
@@ -0,0 +1,5 @@
+#include "hash-table-values.h"
+
+#define HASH_TABLE_NAME hash_table_base_payload
+#define HASH_TABLE_VALUE struct hash_table_payload
+#include "hash-table-base-impl.h"
@@ -4,13 +4,6 @@
 
 #include <stdbool.h>
 
-struct hash_table_base;
-struct hash_table_base *hash_table_base_create();
-void hash_table_base_add_entry(struct hash_table_base *hash_table,
-                               const char *key,
-                               uint32_t value);
-bool hash_table_base_contains(struct hash_table_base *hash_table,
-                              const char *key);
-uint32_t hash_table_base_get_value(struct hash_table_base *hash_table,
-                                   const char* key);
-void hash_table_base_destroy(struct hash_table_base *hash_table);
+#define HASH_TABLE_NAME hash_table_base
+#define HASH_TABLE_VALUE uint32_t
+#include "hash-table-base-decl.h"
@@ -0,0 +1,514 @@
+#include "hash-table-base.h"
+#include "hash-table-v1.h"
+#include "hash-table-v2.h"
+#include "hash-table-v3.h"
+#include "hash-table-lockfree.h"
+#include "hash-table-cuckoo.h"
+#include "hash-table-util.h"
+
+#include <argp.h>
+#include <assert.h>
+#include <errno.h>
+#include <locale.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BYTES_PER_STRING 8
+
+/* Keys for options that only have a long form */
+enum {
+	OPTION_RUNS = 0x100,
+	OPTION_WARMUP,
+	OPTION_ZIPF,
+	OPTION_TABLE,
+	OPTION_HASH,
+	OPTION_LOCK,
+	OPTION_CSV,
+};
+
+struct arguments {
+	uint32_t threads;
+	uint32_t keys;
+	uint32_t runs;
+	uint32_t warmup;
+	double zipf;
+	const char *table;
+	bool csv;
+};
+
+static struct argp_option options[] = {
+	{ "threads", 't', "NUM", 0, "Largest number of threads, runs double from 1."},
+	{ "keys", 'n', "NUM", 0, "Number of keys, also the operations per run."},
+	{ "runs", OPTION_RUNS, "NUM", 0, "Measured runs per workload."},
+	{ "warmup", OPTION_WARMUP, "NUM", 0, "Unmeasured runs before them."},
+	{ "zipf", OPTION_ZIPF, "THETA", 0, "Key skew in [0, 1), 0 is uniform."},
+	{ "table", OPTION_TABLE, "NAME", 0, "Only run base, v1, v2, v3, lockfree, cuckoo or cuckoo-concurrent."},
+	{ "hash", OPTION_HASH, "NAME", 0, "Hash function: djb2, wyhash or crc32c."},
+	{ "lock", OPTION_LOCK, "NAME", 0, "Lock for each v2 stripe: mutex, ttas, mcs or futex."},
+	{ "csv", OPTION_CSV, 0, 0, "Print results as CSV."},
+	{ 0 }
+};
+
+static struct hash_table_options table_options;
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct arguments *arguments = state->input;
+	char *end = NULL;
+	switch (key) {
+	case 't':
+		arguments->threads = parse_uint32_t(arg);
+		break;
+	case 'n':
+		arguments->keys = parse_uint32_t(arg);
+		break;
+	case OPTION_RUNS:
+		arguments->runs = parse_uint32_t(arg);
+		break;
+	case OPTION_WARMUP:
+		arguments->warmup = parse_uint32_t(arg);
+		break;
+	case OPTION_ZIPF:
+		arguments->zipf = strtod(arg, &end);
+		if (*end != 0 || arguments->zipf < 0 || arguments->zipf >= 1) {
+			exit(EINVAL);
+		}
+		break;
+	case OPTION_TABLE:
+		arguments->table = arg;
+		break;
+	case OPTION_HASH:
+		table_options.hash_function = parse_hash_function(arg);
+		break;
+	case OPTION_LOCK:
+		table_options.lock = parse_lock_type(arg);
+		break;
+	case OPTION_CSV:
+		arguments->csv = true;
+		break;
+	}
+	return 0;
+}
+
+/* Every table behind the same interface, so one worker drives them all */
+struct bench_table {
+	const char *name;
+	/* base, v3 and cuckoo are not thread safe, they only run with one thread */
+	bool concurrent;
+	void *(*create)(const struct hash_table_options *options);
+	void (*add_entry)(void *hash_table, const char *key, uint32_t value);
+	bool (*contains)(void *hash_table, const char *key);
+	void (*destroy)(void *hash_table);
+};
+
+#define BENCH_TABLE(version, is_concurrent)                                    \
+	static void *version##_create(const struct hash_table_options *options) \
+	{                                                                      \
+		return hash_table_##version##_create_with_options(options);         \
+	}                                                                      \
+	static void version##_add_entry(void *hash_table, const char *key,     \
+	                                uint32_t value)                        \
+	{                                                                      \
+		hash_table_##version##_add_entry(hash_table, key, value);           \
+	}                                                                      \
+	static bool version##_contains(void *hash_table, const char *key)      \
+	{                                                                      \
+		return hash_table_##version##_contains(hash_table, key);            \
+	}                                                                      \
+	static void version##_destroy(void *hash_table)                        \
+	{                                                                      \
+		hash_table_##version##_destroy(hash_table);                         \
+	}                                                                      \
+	static const struct bench_table version##_bench_table = {              \
+		#version, is_concurrent, version##_create, version##_add_entry,     \
+		version##_contains, version##_destroy,                              \
+	};
+
+BENCH_TABLE(base, false)
+BENCH_TABLE(v1, true)
+BENCH_TABLE(v2, true)
+BENCH_TABLE(v3, false)
+BENCH_TABLE(lockfree, true)
+BENCH_TABLE(cuckoo, false)
+
+/* The concurrent cuckoo table only differs in how it is created */
+static void *cuckoo_concurrent_create(const struct hash_table_options *options)
+{
+	return hash_table_cuckoo_create_concurrent(options);
+}
+
+static const struct bench_table cuckoo_concurrent_bench_table = {
+	"cuckoo-concurrent", true, cuckoo_concurrent_create, cuckoo_add_entry,
+	cuckoo_contains, cuckoo_destroy,
+};
+
+static const struct bench_table *tables[] = {
+	&base_bench_table,
+	&v1_bench_table,
+	&v2_bench_table,
+	&v3_bench_table,
+	&lockfree_bench_table,
+	&cuckoo_bench_table,
+	&cuckoo_concurrent_bench_table,
+};
+
+enum workload {
+	WORKLOAD_INSERT,
+	WORKLOAD_LOOKUP_HIT,
+	WORKLOAD_LOOKUP_MISS,
+	WORKLOAD_UPDATE,
+	/* 90% lookups that hit, 10% updates */
+	WORKLOAD_MIXED,
+	WORKLOAD_COUNT,
+};
+
+static const char *workload_names[WORKLOAD_COUNT] = {
+	"insert", "lookup-hit", "lookup-miss", "update", "mixed",
+};
+
+static struct arguments arguments;
+static char *data;
+static char *missing_data;
+
+static char *get_string(size_t index)
+{
+	return data + (index * BYTES_PER_STRING);
+}
+
+static char *get_missing_string(size_t index)
+{
+	return missing_data + (index * BYTES_PER_STRING);
+}
+
+static uint64_t now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double next_unit(uint64_t *state)
+{
+	return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Zipfian ranks from Gray et al., "Quickly Generating Billion-Record Synthetic
+   Databases", the same generator YCSB uses */
+struct zipf {
+	size_t n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+};
+
+static struct zipf zipf;
+
+static void zipf_init(struct zipf *zipf, size_t n, double theta)
+{
+	double zetan = 0;
+	for (size_t i = 1; i <= n; ++i) {
+		zetan += 1.0 / pow(i, theta);
+	}
+	double zeta2 = 1.0 + 1.0 / pow(2, theta);
+	zipf->n = n;
+	zipf->theta = theta;
+	zipf->alpha = 1.0 / (1.0 - theta);
+	zipf->zetan = zetan;
+	zipf->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+}
+
+/* Returns a key index, ranks are scattered so the hottest keys are not all
+   next to each other in the data */
+static size_t zipf_next(struct zipf *zipf, uint64_t *state)
+{
+	double u = next_unit(state);
+	double uz = u * zipf->zetan;
+	size_t rank;
+	if (uz < 1.0) {
+		rank = 0;
+	}
+	else if (uz < 1.0 + pow(0.5, zipf->theta)) {
+		rank = 1;
+	}
+	else {
+		rank = zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha);
+	}
+	return splitmix64(rank) % zipf->n;
+}
+
+struct worker {
+	pthread_t thread;
+	uint32_t index;
+	uint64_t seed;
+	size_t wrong;
+};
+
+/* What the workers of the current run operate on */
+static const struct bench_table *table;
+static void *hash_table;
+static enum workload workload;
+static uint32_t run_threads_count;
+static uint32_t *latencies;
+
+/* Holds the workers until all of them exist, so none gets a head start
+   while the rest are being created. A mutex and condition variable rather
+   than a pthread_barrier_t, which macOS does not have. */
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t ready;
+	bool open;
+} start_gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false };
+
+static void check(int err, const char *call)
+{
+	if (err != 0) {
+		printf("%s returned %d\n", call, err);
+		exit(err);
+	}
+}
+
+/* Called by each worker, returns once the main thread opens the gate */
+static void wait_at_start_gate(void)
+{
+	check(pthread_mutex_lock(&start_gate.mutex), "pthread_mutex_lock");
+	++start_gate.ready;
+	check(pthread_cond_broadcast(&start_gate.cond), "pthread_cond_broadcast");
+	while (!start_gate.open) {
+		check(pthread_cond_wait(&start_gate.cond, &start_gate.mutex), "pthread_cond_wait");
+	}
+	check(pthread_mutex_unlock(&start_gate.mutex), "pthread_mutex_unlock");
+}
+
+/* Waits for count workers to reach the gate, then lets them all go */
+static void open_start_gate(uint32_t count)
+{
+	check(pthread_mutex_lock(&start_gate.mutex), "pthread_mutex_lock");
+	while (start_gate.ready < count) {
+		check(pthread_cond_wait(&start_gate.cond, &start_gate.mutex), "pthread_cond_wait");
+	}
+	start_gate.open = true;
+	check(pthread_cond_broadcast(&start_gate.cond), "pthread_cond_broadcast");
+	check(pthread_mutex_unlock(&start_gate.mutex), "pthread_mutex_unlock");
+}
+
+/* Each worker does its share of arguments.keys operations, recording the
+   latency of every one at its operation's index */
+static void *run_worker(void *arg)
+{
+	struct worker *worker = arg;
+	size_t begin = (size_t) arguments.keys * worker->index / run_threads_count;
+	size_t end = (size_t) arguments.keys * (worker->index + 1) / run_threads_count;
+	uint64_t state = worker->seed | 1;
+	size_t wrong = 0;
+
+	wait_at_start_gate();
+	for (size_t i = begin; i < end; ++i) {
+		size_t key = workload == WORKLOAD_INSERT || workload == WORKLOAD_LOOKUP_MISS
+			? i : zipf_next(&zipf, &state);
+		bool update = workload == WORKLOAD_UPDATE
+			|| (workload == WORKLOAD_MIXED && next_random(&state) % 10 == 0);
+		uint64_t start = now_nsec();
+		if (workload == WORKLOAD_INSERT || update) {
+			table->add_entry(hash_table, get_string(key), key);
+		}
+		else if (workload == WORKLOAD_LOOKUP_MISS) {
+			wrong += table->contains(hash_table, get_missing_string(key));
+		}
+		else {
+			wrong += !table->contains(hash_table, get_string(key));
+		}
+		latencies[i] = now_nsec() - start;
+	}
+	worker->wrong = wrong;
+	return NULL;
+}
+
+/* Runs one workload once, returning the elapsed nanoseconds */
+static uint64_t run_once(struct worker *workers, uint32_t run)
+{
+	hash_table = table->create(&table_options);
+	if (workload != WORKLOAD_INSERT) {
+		for (size_t i = 0; i < arguments.keys; ++i) {
+			table->add_entry(hash_table, get_string(i), i);
+		}
+	}
+
+	/* No worker of the last run is left, they have all been joined */
+	start_gate.ready = 0;
+	start_gate.open = false;
+	int err;
+	for (uint32_t i = 0; i < run_threads_count; ++i) {
+		workers[i].index = i;
+		workers[i].seed = splitmix64(((uint64_t) run << 32) | i);
+		err = pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+		if (err != 0) {
+			printf("pthread_create returned %d\n", err);
+			exit(err);
+		}
+	}
+	open_start_gate(run_threads_count);
+	uint64_t start = now_nsec();
+	size_t wrong = 0;
+	for (uint32_t i = 0; i < run_threads_count; ++i) {
+		err = pthread_join(workers[i].thread, NULL);
+		if (err != 0) {
+			printf("pthread_join returned %d\n", err);
+			exit(err);
+		}
+		wrong += workers[i].wrong;
+	}
+	uint64_t elapsed = now_nsec() - start;
+	table->destroy(hash_table);
+
+	if (wrong > 0) {
+		fprintf(stderr, "%s %s: %zu lookups returned the wrong result\n",
+		        table->name, workload_names[workload], wrong);
+	}
+	return elapsed;
+}
+
+static int compare_uint32_t(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a;
+	uint32_t y = *(const uint32_t *) b;
+	return (x > y) - (x < y);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t *sorted, size_t count, double p)
+{
+	return sorted[(size_t) (p * (count - 1))];
+}
+
+/* Reports the median throughput of the measured runs, and latency
+   percentiles over every operation of all of them */
+static void run_workload(struct worker *workers)
+{
+	size_t ops = arguments.keys;
+	uint32_t *all_latencies = malloc(ops * arguments.runs * sizeof(uint32_t));
+	double *ops_per_sec = malloc(arguments.runs * sizeof(double));
+	assert(all_latencies != NULL && ops_per_sec != NULL);
+
+	for (uint32_t run = 0; run < arguments.warmup + arguments.runs; ++run) {
+		bool measured = run >= arguments.warmup;
+		latencies = measured ? all_latencies + ops * (run - arguments.warmup)
+		                     : all_latencies;
+		uint64_t elapsed = run_once(workers, run);
+		if (measured) {
+			ops_per_sec[run - arguments.warmup] = ops * 1e9 / (elapsed ? elapsed : 1);
+		}
+	}
+
+	size_t count = ops * arguments.runs;
+	qsort(all_latencies, count, sizeof(uint32_t), compare_uint32_t);
+	qsort(ops_per_sec, arguments.runs, sizeof(double), compare_double);
+	double median = ops_per_sec[arguments.runs / 2];
+	uint32_t p50 = percentile(all_latencies, count, 0.5);
+	uint32_t p99 = percentile(all_latencies, count, 0.99);
+	uint32_t p999 = percentile(all_latencies, count, 0.999);
+	const char *hash = hash_table_hash_name(table_options.hash_function);
+
+	if (arguments.csv) {
+		printf("%s,%s,%s,%u,%.3f,%.0f,%u,%u,%u\n", table->name, hash,
+		       workload_names[workload], run_threads_count, arguments.zipf,
+		       median, p50, p99, p999);
+	}
+	else {
+		printf("Hash table %s %s (%u threads): %'.0f ops/sec, p50 %'u nsec, p99 %'u nsec, p999 %'u nsec\n",
+		       table->name, workload_names[workload], run_threads_count,
+		       median, p50, p99, p999);
+	}
+	fflush(stdout);
+	free(ops_per_sec);
+	free(all_latencies);
+}
+
+/* Keys are 7 random letters, like the tester's. Missing keys end in a digit
+   instead, so no lookup of one can ever hit. */
+static void generate(char *strings, bool missing)
+{
+	uint64_t state = missing ? 43 : 42;
+	for (size_t i = 0; i < arguments.keys; ++i) {
+		char *string = strings + (i * BYTES_PER_STRING);
+		fill_random_letters(string, BYTES_PER_STRING - 1, &state);
+		if (missing) {
+			string[BYTES_PER_STRING - 2] = '0' + next_random(&state) % 10;
+		}
+		string[BYTES_PER_STRING - 1] = 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	arguments.threads = 4;
+	arguments.keys = 100000;
+	arguments.runs = 5;
+	arguments.warmup = 1;
+	arguments.zipf = 0.99;
+	table_options = hash_table_default_options;
+
+	static struct argp argp = { options, parse_opt };
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+	if (arguments.threads == 0 || arguments.keys == 0 || arguments.runs == 0) {
+		exit(EINVAL);
+	}
+
+	if (!arguments.csv) {
+		setlocale(LC_ALL, "en_US.UTF-8");
+	}
+
+	data = calloc(arguments.keys, BYTES_PER_STRING);
+	missing_data = calloc(arguments.keys, BYTES_PER_STRING);
+	assert(data != NULL && missing_data != NULL);
+	generate(data, false);
+	generate(missing_data, true);
+	/* Sizes the lock-free table, which cannot grow, and starts both cuckoo
+	   tables at full size. v2 would also size a Bloom filter from it. */
+	table_options.expected_entries = arguments.keys;
+	zipf_init(&zipf, arguments.keys, arguments.zipf);
+
+	struct worker *workers = calloc(arguments.threads, sizeof(struct worker));
+	assert(workers != NULL);
+
+	if (arguments.csv) {
+		printf("table,hash,workload,threads,zipf,ops_per_sec,p50_nsec,p99_nsec,p999_nsec\n");
+	}
+	for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); ++t) {
+		table = tables[t];
+		if (arguments.table != NULL && strcmp(arguments.table, table->name) != 0) {
+			continue;
+		}
+		for (uint32_t threads = 1; threads <= arguments.threads; threads *= 2) {
+			/* Always finish on the requested count, even if it is not a
+			   power of two */
+			if (threads * 2 > arguments.threads) {
+				threads = arguments.threads;
+			}
+			if (threads > 1 && !table->concurrent) {
+				break;
+			}
+			run_threads_count = threads;
+			for (workload = 0; workload < WORKLOAD_COUNT; ++workload) {
+				run_workload(workers);
+			}
+		}
+	}
+
+	free(workers);
+	free(missing_data);
+	free(data);
+
+	return 0;
+}
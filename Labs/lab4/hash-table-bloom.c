@@ -0,0 +1,111 @@
+#include "hash-table-bloom.h"
+
+#include "hash-table-common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* About 1.2% false positives for a blocked filter while it holds no more
+   than the entries it was sized for */
+#define BITS_PER_ENTRY 10
+#define BITS_PER_KEY 6
+
+#define BLOCK_WORDS 8
+#define BLOCK_BITS (BLOCK_WORDS * 64)
+
+struct bloom_block {
+	atomic_uint_fast64_t words[BLOCK_WORDS];
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct bloom_block) == 64, "a block is one cache line");
+
+void hash_table_bloom_init(struct hash_table_bloom *bloom,
+                           size_t expected_entries,
+                           bool enabled)
+{
+	bloom->enabled = enabled;
+	bloom->block_count = 0;
+	bloom->blocks = NULL;
+	if (!enabled) {
+		return;
+	}
+	if (expected_entries == 0) {
+		expected_entries = HASH_TABLE_CAPACITY;
+	}
+	bloom->block_count = (expected_entries * BITS_PER_ENTRY + BLOCK_BITS - 1) / BLOCK_BITS;
+	bloom->blocks = aligned_alloc(64, bloom->block_count * sizeof(struct bloom_block));
+	assert(bloom->blocks != NULL);
+	hash_table_bloom_clear(bloom);
+}
+
+/* The table's hash picks its bucket from the low bits, so the block and the
+   bits in it come from a remix of the whole hash instead */
+static uint64_t remix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+	return x ^ (x >> 31);
+}
+
+/* Returns the key's block and fills in the bits it needs in each word */
+static struct bloom_block *get_block(struct hash_table_bloom *bloom, uint32_t hash,
+                                     uint64_t masks[BLOCK_WORDS])
+{
+	uint64_t mixed = remix(hash);
+	size_t block = ((mixed >> 32) * bloom->block_count) >> 32;
+	uint64_t bits = remix(mixed);
+	memset(masks, 0, BLOCK_WORDS * sizeof(uint64_t));
+	for (int i = 0; i < BITS_PER_KEY; ++i) {
+		uint32_t bit = (bits >> (i * 9)) & (BLOCK_BITS - 1);
+		masks[bit / 64] |= (uint64_t) 1 << (bit % 64);
+	}
+	return &bloom->blocks[block];
+}
+
+void hash_table_bloom_add(struct hash_table_bloom *bloom, uint32_t hash)
+{
+	if (!bloom->enabled) {
+		return;
+	}
+	uint64_t masks[BLOCK_WORDS];
+	struct bloom_block *block = get_block(bloom, hash, masks);
+	for (int w = 0; w < BLOCK_WORDS; ++w) {
+		/* Most adds find their bits already set once the filter fills, and
+		   a load leaves the line shared where an OR would take it over */
+		if (masks[w] != 0
+		    && (atomic_load_explicit(&block->words[w], memory_order_relaxed) & masks[w]) != masks[w]) {
+			atomic_fetch_or_explicit(&block->words[w], masks[w], memory_order_relaxed);
+		}
+	}
+}
+
+bool hash_table_bloom_may_contain(struct hash_table_bloom *bloom, uint32_t hash)
+{
+	if (!bloom->enabled) {
+		return true;
+	}
+	uint64_t masks[BLOCK_WORDS];
+	struct bloom_block *block = get_block(bloom, hash, masks);
+	for (int w = 0; w < BLOCK_WORDS; ++w) {
+		if ((atomic_load_explicit(&block->words[w], memory_order_relaxed) & masks[w]) != masks[w]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Not safe against concurrent adds or queries */
+void hash_table_bloom_clear(struct hash_table_bloom *bloom)
+{
+	if (bloom->enabled) {
+		memset(bloom->blocks, 0, bloom->block_count * sizeof(struct bloom_block));
+	}
+}
+
+void hash_table_bloom_destroy(struct hash_table_bloom *bloom)
+{
+	free(bloom->blocks);
+	bloom->blocks = NULL;
+}
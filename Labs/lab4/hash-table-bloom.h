@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A blocked Bloom filter over key hashes. Each key sets a few bits inside a
+   single cache line block, so a query reads one line whatever the number of
+   bits. Any number of threads may add and query at once, with bits set by
+   atomic ORs. Nothing is ever removed, so keys removed from the table still
+   answer maybe. When disabled every query answers maybe. */
+struct hash_table_bloom {
+	bool enabled;
+	size_t block_count;
+	struct bloom_block *blocks;
+};
+
+void hash_table_bloom_init(struct hash_table_bloom *bloom,
+                           size_t expected_entries,
+                           bool enabled);
+void hash_table_bloom_add(struct hash_table_bloom *bloom, uint32_t hash);
+bool hash_table_bloom_may_contain(struct hash_table_bloom *bloom, uint32_t hash);
+void hash_table_bloom_clear(struct hash_table_bloom *bloom);
+void hash_table_bloom_destroy(struct hash_table_bloom *bloom);
@@ -2,6 +2,17 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+const struct hash_table_options hash_table_default_options = {
+	.max_load_factor = HASH_TABLE_MAX_LOAD_FACTOR,
+	.slab = true,
+	.hash_function = HASH_TABLE_HASH_DJB2,
+};
 
 uint32_t bernstein_hash(const char *string)
 {
@@ -17,3 +28,109 @@ uint32_t bernstein_hash(const char *string)
 	}
 	return hash;
 }
+
+/* Multiplies into 128 bits and folds the halves together, so every input bit
+   reaches every output bit */
+static uint64_t mum(uint64_t a, uint64_t b)
+{
+	__uint128_t product = (__uint128_t) a * b;
+	return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+uint32_t word_hash(const char *string)
+{
+	static const uint64_t p0 = 0xa0761d6478bd642full;
+	static const uint64_t p1 = 0xe7037ed1a0b428dbull;
+	size_t length = strlen(string);
+	uint64_t hash = p0 ^ length;
+	while (length >= 8) {
+		uint64_t word;
+		memcpy(&word, string, 8);
+		hash = mum(hash ^ word, p1);
+		string += 8;
+		length -= 8;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, string, length);
+	hash = mum(hash ^ tail, p1);
+	hash = mum(hash ^ p0, p1);
+	return (uint32_t) (hash ^ (hash >> 32));
+}
+
+static uint32_t crc32c_software(const char *string)
+{
+	uint32_t crc = ~0u;
+	for (size_t i = 0; string[i] != 0; ++i) {
+		crc ^= (unsigned char) string[i];
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (0x82f63b78u & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(const char *string)
+{
+	size_t length = strlen(string);
+	uint64_t crc = ~0u;
+	while (length >= 8) {
+		uint64_t word;
+		memcpy(&word, string, 8);
+		crc = _mm_crc32_u64(crc, word);
+		string += 8;
+		length -= 8;
+	}
+	while (length > 0) {
+		crc = _mm_crc32_u8(crc, *string);
+		++string;
+		--length;
+	}
+	return ~(uint32_t) crc;
+}
+#endif
+
+uint32_t crc32c_hash(const char *string)
+{
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2")) {
+		return crc32c_sse42(string);
+	}
+#endif
+	return crc32c_software(string);
+}
+
+uint32_t hash_table_hash(enum hash_table_hash_function function,
+                         const char *string)
+{
+	switch (function) {
+	case HASH_TABLE_HASH_WYHASH:
+		return word_hash(string);
+	case HASH_TABLE_HASH_CRC32C:
+		return crc32c_hash(string);
+	default:
+		return bernstein_hash(string);
+	}
+}
+
+const char *hash_table_hash_name(enum hash_table_hash_function function)
+{
+	static const char *names[HASH_TABLE_HASH_COUNT] = {
+		[HASH_TABLE_HASH_DJB2] = "djb2",
+		[HASH_TABLE_HASH_WYHASH] = "wyhash",
+		[HASH_TABLE_HASH_CRC32C] = "crc32c",
+	};
+	return function < HASH_TABLE_HASH_COUNT ? names[function] : NULL;
+}
+
+const char *hash_table_lock_name(enum hash_table_lock_type type)
+{
+	static const char *names[HASH_TABLE_LOCK_COUNT] = {
+		[HASH_TABLE_LOCK_MUTEX] = "mutex",
+		[HASH_TABLE_LOCK_TTAS] = "ttas",
+		[HASH_TABLE_LOCK_MCS] = "mcs",
+		[HASH_TABLE_LOCK_FUTEX] = "futex",
+	};
+	return type < HASH_TABLE_LOCK_COUNT ? names[type] : NULL;
+}
@@ -1,7 +1,94 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Initial number of buckets, tables double from here as they fill up */
 #define HASH_TABLE_CAPACITY 4096
 
+_Static_assert((HASH_TABLE_CAPACITY & (HASH_TABLE_CAPACITY - 1)) == 0,
+               "HASH_TABLE_CAPACITY must be a power of two");
+
+/* Average entries per bucket a table may reach before it doubles */
+#define HASH_TABLE_MAX_LOAD_FACTOR 1.0
+
+/* Names a function of the table being instantiated from a template, see
+   hash-table-base-decl.h */
+#define HASH_TABLE_CONCAT_(name, suffix) name##_##suffix
+#define HASH_TABLE_CONCAT(name, suffix) HASH_TABLE_CONCAT_(name, suffix)
+#define HASH_TABLE_FN(suffix) HASH_TABLE_CONCAT(HASH_TABLE_NAME, suffix)
+
+enum hash_table_hash_function {
+	/* bernstein_hash, one byte at a time */
+	HASH_TABLE_HASH_DJB2,
+	/* wyhash-style multiply-mix over 8 byte words */
+	HASH_TABLE_HASH_WYHASH,
+	/* CRC32C, with the SSE4.2 instruction when the CPU has it */
+	HASH_TABLE_HASH_CRC32C,
+	HASH_TABLE_HASH_COUNT,
+};
+
+enum hash_table_lock_type {
+	/* pthread_mutex_t */
+	HASH_TABLE_LOCK_MUTEX,
+	/* Test-and-test-and-set spinlock with exponential backoff */
+	HASH_TABLE_LOCK_TTAS,
+	/* MCS queue lock, each waiter spins on its own cache line */
+	HASH_TABLE_LOCK_MCS,
+	/* Spins briefly, then sleeps on a futex */
+	HASH_TABLE_LOCK_FUTEX,
+	HASH_TABLE_LOCK_COUNT,
+};
+
+struct hash_table_options {
+	/* Zero keeps the table at HASH_TABLE_CAPACITY buckets forever */
+	double max_load_factor;
+	/* Number of locks for concurrent tables, a power of two no larger than
+	   HASH_TABLE_CAPACITY. Zero gives one per initial bucket. */
+	size_t lock_stripes;
+	/* Allocate nodes from a hash_table_slab rather than one calloc each */
+	bool slab;
+	enum hash_table_hash_function hash_function;
+	/* How many entries the caller expects to add, zero if unknown. Tables
+	   that cannot grow size their buckets from it up front. */
+	size_t expected_entries;
+	/* Have base and v2 strcmp every node of a chain instead of comparing
+	   cached hashes first, only to measure what the hashes save */
+	bool skip_hash_check;
+	/* Copy keys into the table, so callers may free theirs once added */
+	bool own_keys;
+	/* For read-mostly v2 tables: lookups enter an asymmetric epoch, and an
+	   update replaces its node instead of writing the value in place, so
+	   readers need no fence or atomic to read values. Writers pay for it. */
+	bool rcu;
+	/* The kind of lock for each of v2's stripes */
+	enum hash_table_lock_type lock;
+	/* Put a blocked Bloom filter in front of v2 lookups, so most misses
+	   read one cache line instead of a chain. Each bucket array gets its
+	   own, sized for its share of max_load_factor, or from expected_entries
+	   if the table never grows. */
+	bool bloom;
+};
+
+extern const struct hash_table_options hash_table_default_options;
+
+struct hash_table_pair {
+	const char *key;
+	uint32_t value;
+};
+
+struct hash_table_chain_stats {
+	size_t buckets;
+	size_t used_buckets;
+	size_t entries;
+	size_t max_length;
+};
+
 uint32_t bernstein_hash(const char *string);
+uint32_t word_hash(const char *string);
+uint32_t crc32c_hash(const char *string);
+uint32_t hash_table_hash(enum hash_table_hash_function function,
+                         const char *string);
+const char *hash_table_hash_name(enum hash_table_hash_function function);
+const char *hash_table_lock_name(enum hash_table_lock_type type);
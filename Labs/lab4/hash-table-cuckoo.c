@@ -0,0 +1,571 @@
+#include "hash-table-cuckoo.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Every key lives in one of two buckets of BUCKET_SLOTS slots each. A slot
+   holds a one byte fingerprint of its key's hash, zero when it is empty. */
+#define BUCKET_SLOTS 8
+#define EMPTY_FINGERPRINT 0
+
+/* Fraction of slots that may fill up before a table doubles */
+#define MAX_LOAD 0.9
+
+/* Longest chain of displacements an insert follows looking for room */
+#define MAX_PATH 128
+
+/* Times an insert makes room and loses it to another writer before it puts
+   its key in the stash */
+#define MAX_ATTEMPTS 8
+
+/* All a lookup reads until a fingerprint matches is one cache line: the
+   version, the fingerprints, and the values it returns */
+struct bucket {
+	/* Odd while a writer holds the bucket, only used by concurrent tables */
+	uint32_t version;
+	uint8_t fingerprints[BUCKET_SLOTS];
+	uint32_t values[BUCKET_SLOTS];
+} __attribute__((aligned(64)));
+
+/* The keys are a second line per bucket, read only on a fingerprint match */
+struct bucket_keys {
+	const char *keys[BUCKET_SLOTS];
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct bucket) == 64 && sizeof(struct bucket_keys) == 64,
+               "a bucket and its keys must each be one cache line");
+
+/* Keys that found no room. Entries are only ever prepended, so readers walk
+   the list without a lock. */
+struct stash_entry {
+	const char *key;
+	uint32_t value;
+	struct stash_entry *next;
+};
+
+struct hash_table_cuckoo {
+	struct bucket *buckets;
+	struct bucket_keys *keys;
+	size_t capacity;
+	/* Entries in buckets, only kept by tables that grow */
+	size_t size;
+	bool concurrent;
+	struct stash_entry *stash;
+	size_t stashed;
+	pthread_mutex_t stash_lock;
+	/* max_load_factor of zero keeps the table at its first size, own_keys
+	   and slab do not apply */
+	struct hash_table_options options;
+};
+
+/* Where probe's key goes, worked out once per operation */
+struct probe {
+	const char *key;
+	size_t first;
+	size_t second;
+	uint8_t fingerprint;
+};
+
+struct location {
+	size_t bucket;
+	unsigned slot;
+};
+
+static size_t get_capacity(size_t entries)
+{
+	size_t capacity = HASH_TABLE_CAPACITY / BUCKET_SLOTS;
+	while (capacity * BUCKET_SLOTS * MAX_LOAD < entries) {
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+static void init_buckets(struct hash_table_cuckoo *hash_table, size_t capacity)
+{
+	hash_table->buckets = aligned_alloc(64, capacity * sizeof(struct bucket));
+	assert(hash_table->buckets != NULL);
+	memset(hash_table->buckets, 0, capacity * sizeof(struct bucket));
+	hash_table->keys = aligned_alloc(64, capacity * sizeof(struct bucket_keys));
+	assert(hash_table->keys != NULL);
+	memset(hash_table->keys, 0, capacity * sizeof(struct bucket_keys));
+	hash_table->capacity = capacity;
+	hash_table->size = 0;
+}
+
+static struct hash_table_cuckoo *create(const struct hash_table_options *options,
+                                        bool concurrent)
+{
+	struct hash_table_cuckoo *hash_table = calloc(1, sizeof(struct hash_table_cuckoo));
+	assert(hash_table != NULL);
+	init_buckets(hash_table, get_capacity(options->expected_entries));
+	hash_table->concurrent = concurrent;
+	int err = pthread_mutex_init(&hash_table->stash_lock, NULL);
+	if (err != 0) {
+		exit(err);
+	}
+	hash_table->options = *options;
+	return hash_table;
+}
+
+struct hash_table_cuckoo *hash_table_cuckoo_create_with_options(const struct hash_table_options *options)
+{
+	return create(options, false);
+}
+
+struct hash_table_cuckoo *hash_table_cuckoo_create()
+{
+	return hash_table_cuckoo_create_with_options(&hash_table_default_options);
+}
+
+struct hash_table_cuckoo *hash_table_cuckoo_create_concurrent(const struct hash_table_options *options)
+{
+	return create(options, true);
+}
+
+/* Partial-key cuckoo hashing: a key's other bucket comes from the bucket it
+   is in and its fingerprint, so an entry can move without its key being
+   read or hashed again */
+static size_t get_alternate(struct hash_table_cuckoo *hash_table,
+                            size_t bucket,
+                            uint8_t fingerprint)
+{
+	return (bucket ^ (fingerprint * 0x5bd1e995u)) & (hash_table->capacity - 1);
+}
+
+static void make_probe(struct hash_table_cuckoo *hash_table,
+                       struct probe *probe,
+                       const char *key)
+{
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+	probe->key = key;
+	probe->fingerprint = hash >> 24;
+	if (probe->fingerprint == EMPTY_FINGERPRINT) {
+		probe->fingerprint = 1;
+	}
+	probe->first = hash & (hash_table->capacity - 1);
+	probe->second = get_alternate(hash_table, probe->first, probe->fingerprint);
+}
+
+/* Bit i is set when slot i has fingerprint */
+static unsigned match_bucket(struct bucket *bucket, uint8_t fingerprint)
+{
+#ifdef __SSE2__
+	__m128i slots = _mm_loadl_epi64((const __m128i *) bucket->fingerprints);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(slots, _mm_set1_epi8(fingerprint))) & 0xff;
+#else
+	unsigned matches = 0;
+	for (unsigned i = 0; i < BUCKET_SLOTS; ++i) {
+		matches |= (unsigned) (bucket->fingerprints[i] == fingerprint) << i;
+	}
+	return matches;
+#endif
+}
+
+/* Bits 0-7 match the slots of first and bits 8-15 those of second. With
+   SSE2 both buckets' fingerprints are one 16 byte compare. */
+static unsigned match_buckets(struct bucket *first,
+                              struct bucket *second,
+                              uint8_t fingerprint)
+{
+#ifdef __SSE2__
+	__m128i slots = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) first->fingerprints),
+	                                   _mm_loadl_epi64((const __m128i *) second->fingerprints));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(slots, _mm_set1_epi8(fingerprint)));
+#else
+	return match_bucket(first, fingerprint) | match_bucket(second, fingerprint) << BUCKET_SLOTS;
+#endif
+}
+
+static bool find_slot(struct hash_table_cuckoo *hash_table,
+                      struct probe *probe,
+                      struct location *location)
+{
+	unsigned matches = match_buckets(&hash_table->buckets[probe->first],
+	                                 &hash_table->buckets[probe->second],
+	                                 probe->fingerprint);
+	while (matches != 0) {
+		unsigned bit = __builtin_ctz(matches);
+		matches &= matches - 1;
+		location->bucket = bit < BUCKET_SLOTS ? probe->first : probe->second;
+		location->slot = bit % BUCKET_SLOTS;
+		/* A reader racing a writer can see a fingerprint before its key */
+		const char *key = __atomic_load_n(&hash_table->keys[location->bucket].keys[location->slot],
+		                                  __ATOMIC_RELAXED);
+		if (key != NULL && strcmp(key, probe->key) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool find_empty(struct hash_table_cuckoo *hash_table,
+                       size_t bucket,
+                       struct location *location)
+{
+	unsigned empty = match_bucket(&hash_table->buckets[bucket], EMPTY_FINGERPRINT);
+	if (empty == 0) {
+		return false;
+	}
+	location->bucket = bucket;
+	location->slot = __builtin_ctz(empty);
+	return true;
+}
+
+/* The fingerprint goes in last, a slot is not found before it is filled */
+static void set_slot(struct hash_table_cuckoo *hash_table,
+                     struct location *location,
+                     const char *key,
+                     uint8_t fingerprint,
+                     uint32_t value)
+{
+	struct bucket *bucket = &hash_table->buckets[location->bucket];
+	__atomic_store_n(&hash_table->keys[location->bucket].keys[location->slot], key, __ATOMIC_RELAXED);
+	__atomic_store_n(&bucket->values[location->slot], value, __ATOMIC_RELAXED);
+	__atomic_store_n(&bucket->fingerprints[location->slot], fingerprint, __ATOMIC_RELEASE);
+}
+
+static struct stash_entry *find_stashed(struct hash_table_cuckoo *hash_table,
+                                        const char *key)
+{
+	for (struct stash_entry *stash_entry = __atomic_load_n(&hash_table->stash, __ATOMIC_ACQUIRE);
+	     stash_entry != NULL; stash_entry = stash_entry->next) {
+		if (strcmp(stash_entry->key, key) == 0) {
+			return stash_entry;
+		}
+	}
+	return NULL;
+}
+
+/* A writer holds a bucket by making its version odd. Readers that saw the
+   version even before and unchanged after reading know no writer was in. */
+static void lock_bucket(struct bucket *bucket)
+{
+	while (true) {
+		uint32_t version = __atomic_load_n(&bucket->version, __ATOMIC_RELAXED);
+		if ((version & 1) == 0
+		    && __atomic_compare_exchange_n(&bucket->version, &version, version + 1, false,
+		                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			/* Keeps the writes that follow from showing before the odd version */
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+			return;
+		}
+		sched_yield();
+	}
+}
+
+static void unlock_bucket(struct bucket *bucket)
+{
+	__atomic_fetch_add(&bucket->version, 1, __ATOMIC_RELEASE);
+}
+
+/* Locks are taken in bucket order, and no writer holds more than two */
+static void lock_buckets(struct hash_table_cuckoo *hash_table, size_t a, size_t b)
+{
+	if (!hash_table->concurrent) {
+		return;
+	}
+	size_t low = a < b ? a : b;
+	size_t high = a < b ? b : a;
+	lock_bucket(&hash_table->buckets[low]);
+	if (high != low) {
+		lock_bucket(&hash_table->buckets[high]);
+	}
+}
+
+static void unlock_buckets(struct hash_table_cuckoo *hash_table, size_t a, size_t b)
+{
+	if (!hash_table->concurrent) {
+		return;
+	}
+	unlock_bucket(&hash_table->buckets[a]);
+	if (b != a) {
+		unlock_bucket(&hash_table->buckets[b]);
+	}
+}
+
+/* Looks in both buckets at once, retrying if a writer was in either. An
+   entry being moved is in both buckets' critical sections, so a reader
+   never misses it between the two. */
+static bool read_entry(struct hash_table_cuckoo *hash_table,
+                       const char *key,
+                       uint32_t *value)
+{
+	struct probe probe;
+	make_probe(hash_table, &probe, key);
+	struct bucket *first = &hash_table->buckets[probe.first];
+	struct bucket *second = &hash_table->buckets[probe.second];
+	while (true) {
+		uint32_t first_version = __atomic_load_n(&first->version, __ATOMIC_ACQUIRE);
+		uint32_t second_version = __atomic_load_n(&second->version, __ATOMIC_ACQUIRE);
+		if (((first_version | second_version) & 1) != 0) {
+			sched_yield();
+			continue;
+		}
+		struct location location;
+		bool found = find_slot(hash_table, &probe, &location);
+		uint32_t found_value = 0;
+		if (found) {
+			found_value = __atomic_load_n(&hash_table->buckets[location.bucket].values[location.slot],
+			                              __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&first->version, __ATOMIC_RELAXED) != first_version
+		    || __atomic_load_n(&second->version, __ATOMIC_RELAXED) != second_version) {
+			continue;
+		}
+		if (found) {
+			*value = found_value;
+			return true;
+		}
+		break;
+	}
+
+	struct stash_entry *stash_entry = find_stashed(hash_table, key);
+	if (stash_entry == NULL) {
+		return false;
+	}
+	*value = __atomic_load_n(&stash_entry->value, __ATOMIC_RELAXED);
+	return true;
+}
+
+bool hash_table_cuckoo_contains(struct hash_table_cuckoo *hash_table,
+                                const char *key)
+{
+	uint32_t value;
+	return read_entry(hash_table, key, &value);
+}
+
+uint32_t hash_table_cuckoo_get_value(struct hash_table_cuckoo *hash_table,
+                                     const char *key)
+{
+	uint32_t value;
+	bool found = read_entry(hash_table, key, &value);
+	assert(found);
+	return value;
+}
+
+/* With both of probe's buckets held, updates its key or puts it in an empty
+   slot. If there is none it goes in the stash when stash is set, otherwise
+   nothing is added. */
+static bool try_add(struct hash_table_cuckoo *hash_table,
+                    struct probe *probe,
+                    uint32_t value,
+                    bool stash)
+{
+	struct location location;
+	/* Update the value if it already exists */
+	if (find_slot(hash_table, probe, &location)) {
+		__atomic_store_n(&hash_table->buckets[location.bucket].values[location.slot], value,
+		                 __ATOMIC_RELAXED);
+		return true;
+	}
+	struct stash_entry *stash_entry = find_stashed(hash_table, probe->key);
+	if (stash_entry != NULL) {
+		__atomic_store_n(&stash_entry->value, value, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	if (find_empty(hash_table, probe->first, &location)
+	    || find_empty(hash_table, probe->second, &location)) {
+		set_slot(hash_table, &location, probe->key, probe->fingerprint, value);
+		if (!hash_table->concurrent) {
+			++hash_table->size;
+		}
+		return true;
+	}
+	if (!stash) {
+		return false;
+	}
+
+	stash_entry = calloc(1, sizeof(struct stash_entry));
+	assert(stash_entry != NULL);
+	stash_entry->key = probe->key;
+	stash_entry->value = value;
+	pthread_mutex_lock(&hash_table->stash_lock);
+	stash_entry->next = hash_table->stash;
+	__atomic_store_n(&hash_table->stash, stash_entry, __ATOMIC_RELEASE);
+	__atomic_store_n(&hash_table->stashed, hash_table->stashed + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&hash_table->stash_lock);
+	return true;
+}
+
+static uint64_t next_random(void)
+{
+	/* xorshift64, seeded from the address of each thread's own state */
+	static _Thread_local uint64_t state;
+	if (state == 0) {
+		state = (uintptr_t) &state | 1;
+	}
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/* Moves the entry in move's slot to its other bucket, if that has room and
+   the entry is still there. A slot found empty needs no move. */
+static bool move_entry(struct hash_table_cuckoo *hash_table,
+                       struct location *move)
+{
+	struct bucket *bucket = &hash_table->buckets[move->bucket];
+	uint8_t fingerprint = __atomic_load_n(&bucket->fingerprints[move->slot], __ATOMIC_RELAXED);
+	if (fingerprint == EMPTY_FINGERPRINT) {
+		return true;
+	}
+	size_t alternate = get_alternate(hash_table, move->bucket, fingerprint);
+	lock_buckets(hash_table, move->bucket, alternate);
+	bool moved = false;
+	struct location location;
+	if (bucket->fingerprints[move->slot] == fingerprint
+	    && find_empty(hash_table, alternate, &location)) {
+		set_slot(hash_table, &location, hash_table->keys[move->bucket].keys[move->slot],
+		         fingerprint, bucket->values[move->slot]);
+		__atomic_store_n(&bucket->fingerprints[move->slot], EMPTY_FINGERPRINT, __ATOMIC_RELAXED);
+		moved = true;
+	}
+	else if (bucket->fingerprints[move->slot] == EMPTY_FINGERPRINT) {
+		moved = true;
+	}
+	unlock_buckets(hash_table, move->bucket, alternate);
+	return moved;
+}
+
+/* Walks from bucket, each step following a random slot's entry to its other
+   bucket, until a bucket with an empty slot turns up. The entries are then
+   moved from the end of the path back, so each is in one of its two buckets
+   the whole time. Afterwards bucket has an empty slot, unless another writer
+   got in first. */
+static bool make_room(struct hash_table_cuckoo *hash_table, size_t bucket)
+{
+	struct location path[MAX_PATH];
+	size_t length = 0;
+	struct location location;
+	while (!find_empty(hash_table, bucket, &location)) {
+		if (length == MAX_PATH) {
+			return false;
+		}
+		unsigned slot = next_random() % BUCKET_SLOTS;
+		uint8_t fingerprint = __atomic_load_n(&hash_table->buckets[bucket].fingerprints[slot],
+		                                      __ATOMIC_RELAXED);
+		path[length].bucket = bucket;
+		path[length].slot = slot;
+		++length;
+		bucket = get_alternate(hash_table, bucket, fingerprint);
+	}
+	while (length > 0) {
+		--length;
+		if (!move_entry(hash_table, &path[length])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool can_grow(struct hash_table_cuckoo *hash_table)
+{
+	return !hash_table->concurrent && hash_table->options.max_load_factor > 0;
+}
+
+static void grow(struct hash_table_cuckoo *hash_table)
+{
+	struct bucket *old_buckets = hash_table->buckets;
+	struct bucket_keys *old_keys = hash_table->keys;
+	size_t old_capacity = hash_table->capacity;
+	struct stash_entry *stash_entry = hash_table->stash;
+	hash_table->stash = NULL;
+	hash_table->stashed = 0;
+	init_buckets(hash_table, old_capacity * 2);
+
+	for (size_t i = 0; i < old_capacity; ++i) {
+		for (unsigned j = 0; j < BUCKET_SLOTS; ++j) {
+			if (old_buckets[i].fingerprints[j] != EMPTY_FINGERPRINT) {
+				hash_table_cuckoo_add_entry(hash_table, old_keys[i].keys[j],
+				                            old_buckets[i].values[j]);
+			}
+		}
+	}
+	/* The stash is emptied into the bigger table */
+	while (stash_entry != NULL) {
+		struct stash_entry *next = stash_entry->next;
+		hash_table_cuckoo_add_entry(hash_table, stash_entry->key, stash_entry->value);
+		free(stash_entry);
+		stash_entry = next;
+	}
+	free(old_buckets);
+	free(old_keys);
+}
+
+void hash_table_cuckoo_add_entry(struct hash_table_cuckoo *hash_table,
+                                 const char *key,
+                                 uint32_t value)
+{
+	if (can_grow(hash_table)
+	    && hash_table->size + 1 > hash_table->capacity * BUCKET_SLOTS * MAX_LOAD) {
+		grow(hash_table);
+	}
+	struct probe probe;
+	make_probe(hash_table, &probe, key);
+
+	for (unsigned attempt = 0; ; ++attempt) {
+		bool last = attempt == MAX_ATTEMPTS && !can_grow(hash_table);
+		lock_buckets(hash_table, probe.first, probe.second);
+		bool added = try_add(hash_table, &probe, value, last);
+		unlock_buckets(hash_table, probe.first, probe.second);
+		if (added) {
+			return;
+		}
+		/* Both buckets are full, alternate which one to make room in */
+		size_t bucket = attempt % 2 == 0 ? probe.first : probe.second;
+		if (!make_room(hash_table, bucket) && can_grow(hash_table)) {
+			grow(hash_table);
+			make_probe(hash_table, &probe, key);
+		}
+	}
+}
+
+size_t hash_table_cuckoo_stashed(struct hash_table_cuckoo *hash_table)
+{
+	return __atomic_load_n(&hash_table->stashed, __ATOMIC_RELAXED);
+}
+
+void hash_table_cuckoo_for_each(struct hash_table_cuckoo *hash_table,
+                                void (*visit)(const char *key, uint32_t value, void *arg),
+                                void *arg)
+{
+	for (size_t i = 0; i < hash_table->capacity; ++i) {
+		for (unsigned j = 0; j < BUCKET_SLOTS; ++j) {
+			if (hash_table->buckets[i].fingerprints[j] != EMPTY_FINGERPRINT) {
+				visit(hash_table->keys[i].keys[j], hash_table->buckets[i].values[j], arg);
+			}
+		}
+	}
+	for (struct stash_entry *stash_entry = hash_table->stash; stash_entry != NULL;
+	     stash_entry = stash_entry->next) {
+		visit(stash_entry->key, stash_entry->value, arg);
+	}
+}
+
+void hash_table_cuckoo_destroy(struct hash_table_cuckoo *hash_table)
+{
+	struct stash_entry *stash_entry = hash_table->stash;
+	while (stash_entry != NULL) {
+		struct stash_entry *next = stash_entry->next;
+		free(stash_entry);
+		stash_entry = next;
+	}
+	int err = pthread_mutex_destroy(&hash_table->stash_lock);
+	if (err != 0) {
+		exit(err);
+	}
+	free(hash_table->buckets);
+	free(hash_table->keys);
+	free(hash_table);
+}
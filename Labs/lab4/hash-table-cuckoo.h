@@ -0,0 +1,24 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <stdbool.h>
+
+struct hash_table_cuckoo;
+struct hash_table_cuckoo *hash_table_cuckoo_create();
+struct hash_table_cuckoo *hash_table_cuckoo_create_with_options(const struct hash_table_options *options);
+/* A table any number of threads may add to and look up in at once. It does
+   not grow, so it sizes itself from expected_entries. */
+struct hash_table_cuckoo *hash_table_cuckoo_create_concurrent(const struct hash_table_options *options);
+void hash_table_cuckoo_add_entry(struct hash_table_cuckoo *hash_table,
+                                 const char *key,
+                                 uint32_t value);
+bool hash_table_cuckoo_contains(struct hash_table_cuckoo *hash_table,
+                                const char *key);
+uint32_t hash_table_cuckoo_get_value(struct hash_table_cuckoo *hash_table,
+                                     const char* key);
+size_t hash_table_cuckoo_stashed(struct hash_table_cuckoo *hash_table);
+void hash_table_cuckoo_for_each(struct hash_table_cuckoo *hash_table,
+                                void (*visit)(const char *key, uint32_t value, void *arg),
+                                void *arg);
+void hash_table_cuckoo_destroy(struct hash_table_cuckoo *hash_table);
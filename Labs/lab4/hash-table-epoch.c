@@ -0,0 +1,163 @@
+#include "hash-table-epoch.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct epoch_record {
+	pthread_t owner;
+	/* The global epoch the owner saw when it entered its current read
+	   section, zero outside of one. The global epoch starts at 1. */
+	atomic_uint_fast64_t epoch;
+	struct epoch_record *next;
+};
+
+static atomic_uint_fast64_t next_epoch_id = 1;
+
+/* The record the calling thread last used, so entering a read section is
+   normally a compare and two stores */
+static _Thread_local struct {
+	uint64_t epoch_id;
+	struct epoch_record *record;
+} thread_cache;
+
+void hash_table_epoch_init(struct hash_table_epoch *epoch)
+{
+	atomic_init(&epoch->global, 1);
+	atomic_init(&epoch->records, NULL);
+	epoch->id = atomic_fetch_add(&next_epoch_id, 1);
+	epoch->asymmetric = false;
+}
+
+/* Registering is per process and may be repeated */
+static bool register_membarrier(void)
+{
+#ifdef __linux__
+	long commands = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+	return commands >= 0
+	       && (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED) != 0
+	       && syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+	return false;
+#endif
+}
+
+void hash_table_epoch_init_asymmetric(struct hash_table_epoch *epoch)
+{
+	hash_table_epoch_init(epoch);
+	epoch->asymmetric = register_membarrier();
+}
+
+/* The writer's half of an asymmetric domain, a full barrier on every
+   running thread of the process */
+static void barrier_all_threads(void)
+{
+#ifdef __linux__
+	if (syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) != 0) {
+		abort();
+	}
+#endif
+}
+
+/* Threads keep their record for the life of the domain. A thread that has
+   exited leaves its record idle, and a later thread reusing its pthread_t
+   picks it up again, so the list stays about as long as the number of
+   threads that ever ran at once. */
+static struct epoch_record *get_record(struct hash_table_epoch *epoch)
+{
+	if (thread_cache.epoch_id == epoch->id) {
+		return thread_cache.record;
+	}
+
+	pthread_t self = pthread_self();
+	struct epoch_record *record = atomic_load(&epoch->records);
+	while (record != NULL && !pthread_equal(record->owner, self)) {
+		record = record->next;
+	}
+	if (record == NULL) {
+		record = calloc(1, sizeof(struct epoch_record));
+		assert(record != NULL);
+		record->owner = self;
+		atomic_init(&record->epoch, 0);
+		record->next = atomic_load(&epoch->records);
+		while (!atomic_compare_exchange_weak(&epoch->records, &record->next, record)) {
+		}
+	}
+	thread_cache.epoch_id = epoch->id;
+	thread_cache.record = record;
+	return record;
+}
+
+struct epoch_record *hash_table_epoch_enter(struct hash_table_epoch *epoch)
+{
+	struct epoch_record *record = get_record(epoch);
+	/* Sequentially consistent, so a writer scanning the records after
+	   unlinking a node either sees this reader or this reader sees the
+	   unlink. In an asymmetric domain the writer's membarrier stands in
+	   for the fence, and only the compiler has to be kept in order. */
+	if (epoch->asymmetric) {
+		atomic_store_explicit(&record->epoch,
+		                      atomic_load_explicit(&epoch->global, memory_order_relaxed),
+		                      memory_order_relaxed);
+		atomic_signal_fence(memory_order_seq_cst);
+		return record;
+	}
+	atomic_store(&record->epoch, atomic_load(&epoch->global));
+	atomic_thread_fence(memory_order_seq_cst);
+	return record;
+}
+
+void hash_table_epoch_exit(struct epoch_record *record)
+{
+	atomic_store_explicit(&record->epoch, 0, memory_order_release);
+}
+
+/* Called after unlinking a node, the fence keeps the unlink from being
+   reordered after the load */
+uint64_t hash_table_epoch_current(struct hash_table_epoch *epoch)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	return atomic_load(&epoch->global);
+}
+
+/* Advances the global epoch if every active reader has caught up with it */
+uint64_t hash_table_epoch_advance(struct hash_table_epoch *epoch)
+{
+	if (epoch->asymmetric) {
+		barrier_all_threads();
+	}
+	uint64_t global = atomic_load(&epoch->global);
+	for (struct epoch_record *record = atomic_load(&epoch->records);
+	     record != NULL; record = record->next) {
+		uint64_t seen = atomic_load(&record->epoch);
+		if (seen != 0 && seen != global) {
+			return global;
+		}
+	}
+	if (atomic_compare_exchange_strong(&epoch->global, &global, global + 1)) {
+		return global + 1;
+	}
+	return global;
+}
+
+bool hash_table_epoch_safe(struct hash_table_epoch *epoch, uint64_t retired)
+{
+	return atomic_load(&epoch->global) >= retired + 2;
+}
+
+void hash_table_epoch_destroy(struct hash_table_epoch *epoch)
+{
+	struct epoch_record *record = atomic_load(&epoch->records);
+	while (record != NULL) {
+		struct epoch_record *next = record->next;
+		free(record);
+		record = next;
+	}
+	atomic_store(&epoch->records, NULL);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Epoch-based reclamation. Readers wrap every walk of shared nodes in
+   hash_table_epoch_enter and hash_table_epoch_exit. A writer that unlinks a
+   node notes hash_table_epoch_current, and may free the node once
+   hash_table_epoch_safe says every reader that could still hold it has left.
+   Checking is a load. Only hash_table_epoch_advance moves the epoch on, so
+   writers can call it once per batch of retired nodes, without their locks.
+
+   The global epoch only moves from e to e + 1 once every reader inside a
+   read section has seen e. A node unlinked during e can only be held by
+   readers that entered during e - 1 or e, so after two advances none remain.
+   Readers never wait, and a reader that stays inside a read section only
+   holds back reclamation, never other readers or writers.
+
+   An asymmetric domain moves the cost of ordering off the readers, for
+   read-mostly tables. Entering a read section is then a plain store, and a
+   writer trying to advance the epoch first makes every thread of the process
+   run a full barrier with membarrier(2), an interrupt to every CPU running
+   one of them. Where membarrier is missing, an
+   asymmetric domain behaves like a normal one. */
+struct hash_table_epoch {
+	atomic_uint_fast64_t global;
+	/* One record per thread that has read under this epoch, only freed by
+	   hash_table_epoch_destroy */
+	struct epoch_record *_Atomic records;
+	/* Tells this domain apart in each thread's cache of its last record */
+	uint64_t id;
+	bool asymmetric;
+};
+
+void hash_table_epoch_init(struct hash_table_epoch *epoch);
+void hash_table_epoch_init_asymmetric(struct hash_table_epoch *epoch);
+struct epoch_record *hash_table_epoch_enter(struct hash_table_epoch *epoch);
+void hash_table_epoch_exit(struct epoch_record *record);
+uint64_t hash_table_epoch_current(struct hash_table_epoch *epoch);
+bool hash_table_epoch_safe(struct hash_table_epoch *epoch, uint64_t retired);
+uint64_t hash_table_epoch_advance(struct hash_table_epoch *epoch);
+void hash_table_epoch_destroy(struct hash_table_epoch *epoch);
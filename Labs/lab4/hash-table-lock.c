@@ -0,0 +1,266 @@
+#include "hash-table-lock.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Waiters spin this many rounds before they yield their CPU (TTAS, MCS) or
+   sleep (futex). Spinning only pays while the holder is running, so a
+   waiter that has spun this long gives the holder a chance to run. */
+#define SPIN_ROUNDS 128
+/* TTAS backoff doubles from the first to the last */
+#define BACKOFF_MIN 4
+#define BACKOFF_MAX 1024
+
+struct mcs_node {
+	struct mcs_node *_Atomic next;
+	atomic_bool locked;
+	bool in_use;
+} __attribute__((aligned(64)));
+
+/* Queue nodes for the MCS locks this thread holds or waits on */
+static _Thread_local struct mcs_node mcs_nodes[HASH_TABLE_LOCK_MAX_HELD];
+
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/* Without futexes the sleeping lock degrades to yielding */
+static void futex_wait(atomic_int *word, int value)
+{
+#ifdef __linux__
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+	(void) word;
+	(void) value;
+	sched_yield();
+#endif
+}
+
+static void futex_wake(atomic_int *word)
+{
+#ifdef __linux__
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+	(void) word;
+#endif
+}
+
+int hash_table_lock_init(struct hash_table_lock *lock,
+                         enum hash_table_lock_type type)
+{
+	assert(type < HASH_TABLE_LOCK_COUNT);
+	lock->type = type;
+	lock->holder = NULL;
+	switch (type) {
+	case HASH_TABLE_LOCK_MUTEX:
+		return pthread_mutex_init(&lock->mutex, NULL);
+	case HASH_TABLE_LOCK_MCS:
+		atomic_init(&lock->tail, NULL);
+		return 0;
+	default:
+		atomic_init(&lock->word, 0);
+		return 0;
+	}
+}
+
+static bool ttas_try_acquire(struct hash_table_lock *lock)
+{
+	return atomic_load_explicit(&lock->word, memory_order_relaxed) == 0
+	       && atomic_exchange_explicit(&lock->word, 1, memory_order_acquire) == 0;
+}
+
+/* Spins on a plain load, so waiters only share the line while it changes,
+   and backs off between attempts so they do not all retry at once */
+static void ttas_acquire(struct hash_table_lock *lock)
+{
+	unsigned int backoff = BACKOFF_MIN;
+	while (!ttas_try_acquire(lock)) {
+		for (unsigned int i = 0; i < backoff; ++i) {
+			cpu_relax();
+		}
+		if (backoff < BACKOFF_MAX) {
+			backoff *= 2;
+		}
+		else {
+			sched_yield();
+		}
+	}
+}
+
+static struct mcs_node *get_mcs_node(void)
+{
+	for (size_t i = 0; i < HASH_TABLE_LOCK_MAX_HELD; ++i) {
+		if (!mcs_nodes[i].in_use) {
+			mcs_nodes[i].in_use = true;
+			atomic_store_explicit(&mcs_nodes[i].next, NULL, memory_order_relaxed);
+			atomic_store_explicit(&mcs_nodes[i].locked, true, memory_order_relaxed);
+			return &mcs_nodes[i];
+		}
+	}
+	/* More MCS locks held at once than HASH_TABLE_LOCK_MAX_HELD */
+	abort();
+}
+
+/* Joins the queue, then spins on its own node until the thread ahead
+   hands the lock over, so waiters never touch the lock's line again */
+static void mcs_acquire(struct hash_table_lock *lock)
+{
+	struct mcs_node *node = get_mcs_node();
+	struct mcs_node *prev = atomic_exchange_explicit(&lock->tail, node, memory_order_acq_rel);
+	if (prev != NULL) {
+		atomic_store_explicit(&prev->next, node, memory_order_release);
+		unsigned int spins = 0;
+		while (atomic_load_explicit(&node->locked, memory_order_acquire)) {
+			if (++spins < SPIN_ROUNDS) {
+				cpu_relax();
+			}
+			else {
+				sched_yield();
+			}
+		}
+	}
+	lock->holder = node;
+}
+
+static bool mcs_try_acquire(struct hash_table_lock *lock)
+{
+	struct mcs_node *node = get_mcs_node();
+	struct mcs_node *expected = NULL;
+	if (atomic_compare_exchange_strong_explicit(&lock->tail, &expected, node,
+	                                            memory_order_acquire,
+	                                            memory_order_relaxed)) {
+		lock->holder = node;
+		return true;
+	}
+	node->in_use = false;
+	return false;
+}
+
+static void mcs_release(struct hash_table_lock *lock)
+{
+	struct mcs_node *node = lock->holder;
+	struct mcs_node *next = atomic_load_explicit(&node->next, memory_order_acquire);
+	if (next == NULL) {
+		struct mcs_node *expected = node;
+		if (atomic_compare_exchange_strong_explicit(&lock->tail, &expected, NULL,
+		                                            memory_order_release,
+		                                            memory_order_relaxed)) {
+			node->in_use = false;
+			return;
+		}
+		/* A thread has swapped itself in as tail but not linked in yet */
+		while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL) {
+			cpu_relax();
+		}
+	}
+	atomic_store_explicit(&next->locked, false, memory_order_release);
+	node->in_use = false;
+}
+
+static bool futex_try_acquire(struct hash_table_lock *lock)
+{
+	int expected = 0;
+	return atomic_load_explicit(&lock->word, memory_order_relaxed) == 0
+	       && atomic_compare_exchange_strong_explicit(&lock->word, &expected, 1,
+	                                                  memory_order_acquire,
+	                                                  memory_order_relaxed);
+}
+
+/* Spins for a holder that is about to release, then marks the lock as
+   waited on and sleeps until a release wakes it. The releasing thread only
+   makes the wake system call when the word says someone may be asleep. */
+static void futex_acquire(struct hash_table_lock *lock)
+{
+	for (int spin = 0; spin < SPIN_ROUNDS; ++spin) {
+		if (futex_try_acquire(lock)) {
+			return;
+		}
+		cpu_relax();
+	}
+	while (atomic_exchange_explicit(&lock->word, 2, memory_order_acquire) != 0) {
+		futex_wait(&lock->word, 2);
+	}
+}
+
+static void futex_release(struct hash_table_lock *lock)
+{
+	if (atomic_exchange_explicit(&lock->word, 0, memory_order_release) == 2) {
+		futex_wake(&lock->word);
+	}
+}
+
+void hash_table_lock_acquire(struct hash_table_lock *lock)
+{
+	int ret;
+	switch (lock->type) {
+	case HASH_TABLE_LOCK_MUTEX:
+		if ((ret = pthread_mutex_lock(&lock->mutex)) != 0) {
+			exit(ret);
+		}
+		break;
+	case HASH_TABLE_LOCK_TTAS:
+		ttas_acquire(lock);
+		break;
+	case HASH_TABLE_LOCK_MCS:
+		mcs_acquire(lock);
+		break;
+	default:
+		futex_acquire(lock);
+		break;
+	}
+}
+
+bool hash_table_lock_try_acquire(struct hash_table_lock *lock)
+{
+	switch (lock->type) {
+	case HASH_TABLE_LOCK_MUTEX:
+		return pthread_mutex_trylock(&lock->mutex) == 0;
+	case HASH_TABLE_LOCK_TTAS:
+		return ttas_try_acquire(lock);
+	case HASH_TABLE_LOCK_MCS:
+		return mcs_try_acquire(lock);
+	default:
+		return futex_try_acquire(lock);
+	}
+}
+
+void hash_table_lock_release(struct hash_table_lock *lock)
+{
+	int ret;
+	switch (lock->type) {
+	case HASH_TABLE_LOCK_MUTEX:
+		if ((ret = pthread_mutex_unlock(&lock->mutex)) != 0) {
+			exit(ret);
+		}
+		break;
+	case HASH_TABLE_LOCK_TTAS:
+		atomic_store_explicit(&lock->word, 0, memory_order_release);
+		break;
+	case HASH_TABLE_LOCK_MCS:
+		mcs_release(lock);
+		break;
+	default:
+		futex_release(lock);
+		break;
+	}
+}
+
+int hash_table_lock_destroy(struct hash_table_lock *lock)
+{
+	if (lock->type == HASH_TABLE_LOCK_MUTEX) {
+		return pthread_mutex_destroy(&lock->mutex);
+	}
+	return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/* A lock whose implementation is picked when it is initialized, for locks
+   held only briefly, see enum hash_table_lock_type. A thread may hold up to
+   HASH_TABLE_LOCK_MAX_HELD MCS locks at once. */
+#define HASH_TABLE_LOCK_MAX_HELD 4
+
+struct hash_table_lock {
+	enum hash_table_lock_type type;
+	union {
+		pthread_mutex_t mutex;
+		/* TTAS: 0 or 1. Futex: 0 unlocked, 1 locked, 2 locked and maybe
+		   waited on. */
+		atomic_int word;
+		/* MCS: the last thread in the queue */
+		struct mcs_node *_Atomic tail;
+	};
+	/* MCS: the holder's queue node, only touched by the holder */
+	struct mcs_node *holder;
+};
+
+/* Returns 0, or the error from pthread_mutex_init */
+int hash_table_lock_init(struct hash_table_lock *lock,
+                         enum hash_table_lock_type type);
+void hash_table_lock_acquire(struct hash_table_lock *lock);
+bool hash_table_lock_try_acquire(struct hash_table_lock *lock);
+void hash_table_lock_release(struct hash_table_lock *lock);
+/* Returns 0, or the error from pthread_mutex_destroy */
+int hash_table_lock_destroy(struct hash_table_lock *lock);
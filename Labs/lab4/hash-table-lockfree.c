@@ -0,0 +1,279 @@
+#include "hash-table-lockfree.h"
+#include "hash-table-slab.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+struct list_entry {
+  const char *key;
+  // The full hash of key, so most mismatches skip the strcmp.
+  uint32_t hash;
+  uint32_t value;
+  SLIST_ENTRY(list_entry) pointers;
+};
+
+SLIST_HEAD(list_head, list_entry);
+
+// Nothing here takes a lock. A writer fills in a node and swings the bucket's
+// head to it with a compare-and-swap, retrying against the new head if another
+// writer got there first, so a preempted thread never holds anyone else up.
+// Nodes are only ever prepended and never unlinked while the table is in use,
+// which is what keeps walking a chain safe without a lock or any reclamation.
+//
+// Growing would need every writer to agree on which bucket array is current,
+// so the bucket count is fixed at creation, sized from expected_entries.
+
+static struct list_entry *load_first(struct list_head *list_head) {
+  return __atomic_load_n(&SLIST_FIRST(list_head), __ATOMIC_ACQUIRE);
+}
+
+static struct list_entry *load_next(struct list_entry *list_entry) {
+  return __atomic_load_n(&SLIST_NEXT(list_entry, pointers), __ATOMIC_ACQUIRE);
+}
+
+// A slab is not thread safe, so each thread allocates nodes from its own.
+// A thread's slab for a table is created the first time it inserts into it
+// and pushed onto the table's list, so destroy can find it. A thread that
+// comes back to the table finds its slab again by owner, and a later thread
+// reusing an exited thread's pthread_t picks up where that one left off.
+struct thread_slab {
+  struct hash_table_slab slab;
+  pthread_t owner;
+  // A node the owner allocated but lost the race to insert, kept for its
+  // next insert into this table.
+  struct list_entry *spare;
+  struct thread_slab *next;
+};
+
+struct hash_table_lockfree {
+  struct list_head *buckets;
+  size_t capacity;
+  // Distinguishes this table in the per-thread cache below, unlike its
+  // address, which a later table may reuse.
+  uint64_t id;
+  struct thread_slab *_Atomic slabs;
+  struct hash_table_options options;
+};
+
+static atomic_uint_fast64_t next_table_id = 1;
+
+// The slab the calling thread last used, so runs of inserts into one table
+// skip the search.
+static _Thread_local struct {
+  uint64_t table_id;
+  struct thread_slab *thread_slab;
+} thread_cache;
+
+struct hash_table_lockfree *
+hash_table_lockfree_create_with_options(const struct hash_table_options *options) {
+  struct hash_table_lockfree *hash_table =
+      calloc(1, sizeof(struct hash_table_lockfree));
+  assert(hash_table != NULL);
+
+  size_t capacity = HASH_TABLE_CAPACITY;
+  if (options->max_load_factor > 0) {
+    while (capacity * options->max_load_factor < options->expected_entries) {
+      capacity *= 2;
+    }
+  }
+  hash_table->buckets = calloc(capacity, sizeof(struct list_head));
+  assert(hash_table->buckets != NULL);
+  for (size_t i = 0; i < capacity; ++i) {
+    SLIST_INIT(&hash_table->buckets[i]);
+  }
+  hash_table->capacity = capacity;
+  hash_table->id = atomic_fetch_add(&next_table_id, 1);
+  atomic_init(&hash_table->slabs, NULL);
+  hash_table->options = *options;
+  return hash_table;
+}
+
+struct hash_table_lockfree *hash_table_lockfree_create() {
+  return hash_table_lockfree_create_with_options(&hash_table_default_options);
+}
+
+static uint32_t get_hash(struct hash_table_lockfree *hash_table,
+                         const char *key) {
+  return hash_table_hash(hash_table->options.hash_function, key);
+}
+
+static struct list_head *get_list_head(struct hash_table_lockfree *hash_table,
+                                       uint32_t hash) {
+  return &hash_table->buckets[hash & (hash_table->capacity - 1)];
+}
+
+// Searches the chain from first up to, but not including, stop.
+static struct list_entry *find_entry(struct list_entry *first,
+                                     struct list_entry *stop, const char *key,
+                                     uint32_t hash) {
+  for (struct list_entry *list_entry = first; list_entry != stop;
+       list_entry = load_next(list_entry)) {
+    if (list_entry->hash == hash && strcmp(list_entry->key, key) == 0) {
+      return list_entry;
+    }
+  }
+  return NULL;
+}
+
+static struct thread_slab *
+get_thread_slab(struct hash_table_lockfree *hash_table) {
+  if (thread_cache.table_id == hash_table->id) {
+    return thread_cache.thread_slab;
+  }
+
+  pthread_t self = pthread_self();
+  struct thread_slab *thread_slab = atomic_load(&hash_table->slabs);
+  while (thread_slab != NULL && !pthread_equal(thread_slab->owner, self)) {
+    thread_slab = thread_slab->next;
+  }
+  if (thread_slab == NULL) {
+    thread_slab = calloc(1, sizeof(struct thread_slab));
+    assert(thread_slab != NULL);
+    hash_table_slab_init(&thread_slab->slab, sizeof(struct list_entry),
+                         hash_table->options.slab);
+    thread_slab->owner = self;
+    thread_slab->next = atomic_load(&hash_table->slabs);
+    while (!atomic_compare_exchange_weak(&hash_table->slabs, &thread_slab->next,
+                                         thread_slab)) {
+    }
+  }
+  thread_cache.table_id = hash_table->id;
+  thread_cache.thread_slab = thread_slab;
+  return thread_slab;
+}
+
+static struct list_entry *alloc_entry(struct hash_table_lockfree *hash_table) {
+  struct thread_slab *thread_slab = get_thread_slab(hash_table);
+  if (thread_slab->spare != NULL) {
+    struct list_entry *list_entry = thread_slab->spare;
+    thread_slab->spare = NULL;
+    return list_entry;
+  }
+  return hash_table_slab_alloc(&thread_slab->slab);
+}
+
+void hash_table_lockfree_add_entry(struct hash_table_lockfree *hash_table,
+                                   const char *key, uint32_t value) {
+  assert(key != NULL);
+  uint32_t hash = get_hash(hash_table, key);
+  struct list_head *list_head = get_list_head(hash_table, hash);
+  struct list_entry *first = load_first(list_head);
+  struct list_entry *searched = NULL;
+  struct list_entry *list_entry = NULL;
+
+  while (true) {
+    // Only nodes pushed since the last attempt can hold the key.
+    struct list_entry *existing = find_entry(first, searched, key, hash);
+    // Update the value if it already exists
+    if (existing != NULL) {
+      __atomic_store_n(&existing->value, value, __ATOMIC_RELAXED);
+      // A node that lost the race is unreachable, calloc'd ones can just go.
+      if (list_entry != NULL && hash_table->options.slab) {
+        get_thread_slab(hash_table)->spare = list_entry;
+      } else {
+        free(list_entry);
+      }
+      return;
+    }
+
+    if (list_entry == NULL) {
+      list_entry = alloc_entry(hash_table);
+      list_entry->key = key;
+      list_entry->hash = hash;
+      list_entry->value = value;
+    }
+    SLIST_NEXT(list_entry, pointers) = first;
+    searched = first;
+    // On failure first is reloaded with the current head.
+    if (__atomic_compare_exchange_n(&SLIST_FIRST(list_head), &first,
+                                    list_entry, false, __ATOMIC_RELEASE,
+                                    __ATOMIC_ACQUIRE)) {
+      return;
+    }
+  }
+}
+
+// Without locks there is nothing to amortize across a batch.
+void hash_table_lockfree_add_entries(struct hash_table_lockfree *hash_table,
+                                     const struct hash_table_pair *pairs,
+                                     size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    hash_table_lockfree_add_entry(hash_table, pairs[i].key, pairs[i].value);
+  }
+}
+
+static struct list_entry *get_entry(struct hash_table_lockfree *hash_table,
+                                    const char *key) {
+  assert(key != NULL);
+  uint32_t hash = get_hash(hash_table, key);
+  struct list_head *list_head = get_list_head(hash_table, hash);
+  return find_entry(load_first(list_head), NULL, key, hash);
+}
+
+bool hash_table_lockfree_contains(struct hash_table_lockfree *hash_table,
+                                  const char *key) {
+  return get_entry(hash_table, key) != NULL;
+}
+
+uint32_t hash_table_lockfree_get_value(struct hash_table_lockfree *hash_table,
+                                       const char *key) {
+  struct list_entry *list_entry = get_entry(hash_table, key);
+  assert(list_entry != NULL);
+  return __atomic_load_n(&list_entry->value, __ATOMIC_RELAXED);
+}
+
+size_t hash_table_lockfree_allocations(struct hash_table_lockfree *hash_table) {
+  size_t allocations = 0;
+  for (struct thread_slab *thread_slab = atomic_load(&hash_table->slabs);
+       thread_slab != NULL; thread_slab = thread_slab->next) {
+    allocations += thread_slab->slab.allocations;
+  }
+  return allocations;
+}
+
+void hash_table_lockfree_chain_stats(struct hash_table_lockfree *hash_table,
+                                     struct hash_table_chain_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->buckets = hash_table->capacity;
+  for (size_t i = 0; i < hash_table->capacity; ++i) {
+    size_t length = 0;
+    for (struct list_entry *list_entry = load_first(&hash_table->buckets[i]);
+         list_entry != NULL; list_entry = load_next(list_entry)) {
+      ++length;
+    }
+    if (length > 0) {
+      ++stats->used_buckets;
+    }
+    if (length > stats->max_length) {
+      stats->max_length = length;
+    }
+    stats->entries += length;
+  }
+}
+
+void hash_table_lockfree_destroy(struct hash_table_lockfree *hash_table) {
+  // Slab nodes are released together with their thread's chunks.
+  for (size_t i = 0; i < hash_table->capacity && !hash_table->options.slab;
+       ++i) {
+    struct list_head *list_head = &hash_table->buckets[i];
+    struct list_entry *list_entry = NULL;
+    while (!SLIST_EMPTY(list_head)) {
+      list_entry = SLIST_FIRST(list_head);
+      SLIST_REMOVE_HEAD(list_head, pointers);
+      free(list_entry);
+    }
+  }
+  struct thread_slab *thread_slab = atomic_load(&hash_table->slabs);
+  while (thread_slab != NULL) {
+    struct thread_slab *next = thread_slab->next;
+    hash_table_slab_destroy(&thread_slab->slab);
+    free(thread_slab);
+    thread_slab = next;
+  }
+  free(hash_table->buckets);
+  free(hash_table);
+}
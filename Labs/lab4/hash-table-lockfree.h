@@ -0,0 +1,24 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <stdbool.h>
+
+struct hash_table_lockfree;
+struct hash_table_lockfree *hash_table_lockfree_create();
+struct hash_table_lockfree *
+hash_table_lockfree_create_with_options(const struct hash_table_options *options);
+void hash_table_lockfree_add_entry(struct hash_table_lockfree *hash_table,
+                                   const char *key,
+                                   uint32_t value);
+void hash_table_lockfree_add_entries(struct hash_table_lockfree *hash_table,
+                                     const struct hash_table_pair *pairs,
+                                     size_t count);
+bool hash_table_lockfree_contains(struct hash_table_lockfree *hash_table,
+                                  const char *key);
+uint32_t hash_table_lockfree_get_value(struct hash_table_lockfree *hash_table,
+                                       const char* key);
+size_t hash_table_lockfree_allocations(struct hash_table_lockfree *hash_table);
+void hash_table_lockfree_chain_stats(struct hash_table_lockfree *hash_table,
+                                     struct hash_table_chain_stats *stats);
+void hash_table_lockfree_destroy(struct hash_table_lockfree *hash_table);
@@ -0,0 +1,90 @@
+#include "hash-table-slab.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Chunks start small, since a table may keep thousands of mostly empty slabs,
+   and double up to a limit as the slab fills */
+#define SLAB_MIN_CHUNK_OBJECTS 16
+#define SLAB_MAX_CHUNK_OBJECTS 4096
+
+struct slab_chunk {
+	struct slab_chunk *next;
+	max_align_t objects[];
+};
+
+/* A freed object holds the link to the next one itself */
+struct slab_free_object {
+	struct slab_free_object *next;
+};
+
+void hash_table_slab_init(struct hash_table_slab *slab,
+                          size_t object_size,
+                          bool enabled)
+{
+	memset(slab, 0, sizeof(*slab));
+	slab->enabled = enabled;
+	/* Keep every object aligned for pointers */
+	slab->object_size = (object_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	slab->chunk_objects = SLAB_MIN_CHUNK_OBJECTS;
+}
+
+void *hash_table_slab_alloc(struct hash_table_slab *slab)
+{
+	if (!slab->enabled) {
+		++slab->allocations;
+		void *object = calloc(1, slab->object_size);
+		assert(object != NULL);
+		return object;
+	}
+
+	if (slab->free_objects != NULL) {
+		struct slab_free_object *object = slab->free_objects;
+		slab->free_objects = object->next;
+		memset(object, 0, slab->object_size);
+		return object;
+	}
+
+	if (slab->next == slab->end) {
+		size_t bytes = slab->chunk_objects * slab->object_size;
+		struct slab_chunk *chunk = calloc(1, sizeof(struct slab_chunk) + bytes);
+		assert(chunk != NULL);
+		++slab->allocations;
+		chunk->next = slab->chunks;
+		slab->chunks = chunk;
+		slab->next = (char *) chunk->objects;
+		slab->end = slab->next + bytes;
+		if (slab->chunk_objects < SLAB_MAX_CHUNK_OBJECTS) {
+			slab->chunk_objects *= 2;
+		}
+	}
+
+	void *object = slab->next;
+	slab->next += slab->object_size;
+	return object;
+}
+
+void hash_table_slab_free(struct hash_table_slab *slab, void *object)
+{
+	if (!slab->enabled) {
+		free(object);
+		return;
+	}
+	struct slab_free_object *free_object = object;
+	free_object->next = slab->free_objects;
+	slab->free_objects = free_object;
+}
+
+void hash_table_slab_destroy(struct hash_table_slab *slab)
+{
+	while (slab->chunks != NULL) {
+		struct slab_chunk *chunk = slab->chunks;
+		slab->chunks = chunk->next;
+		free(chunk);
+	}
+	slab->next = NULL;
+	slab->end = NULL;
+	slab->free_objects = NULL;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Hands out fixed size, zeroed objects from large chunks so that inserts do
+   not each go through calloc and destroying a table frees a few chunks
+   instead of every node. A slab is not thread safe, concurrent tables keep
+   one per lock. When disabled it falls back to calloc for every object so
+   the two can be compared, and the table has to free its objects itself.
+   Objects given back with hash_table_slab_free are handed out again before
+   the current chunk is used up. */
+struct hash_table_slab {
+	bool enabled;
+	size_t object_size;
+	size_t chunk_objects;
+	char *next;
+	char *end;
+	struct slab_chunk *chunks;
+	struct slab_free_object *free_objects;
+	/* Calls made to the system allocator, chunks or single objects */
+	size_t allocations;
+};
+
+void hash_table_slab_init(struct hash_table_slab *slab,
+                          size_t object_size,
+                          bool enabled);
+void *hash_table_slab_alloc(struct hash_table_slab *slab);
+void hash_table_slab_free(struct hash_table_slab *slab, void *object);
+void hash_table_slab_destroy(struct hash_table_slab *slab);
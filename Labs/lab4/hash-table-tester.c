@@ -1,13 +1,29 @@
+#define _GNU_SOURCE
+
 #include "hash-table-base.h"
 #include "hash-table-v1.h"
 #include "hash-table-v2.h"
+#include "hash-table-v3.h"
+#include "hash-table-lockfree.h"
+#include "hash-table-cuckoo.h"
+#include "hash-table-values.h"
+#include "hash-table-util.h"
 
 #include <argp.h>
+#include <assert.h>
+#include <errno.h>
 #include <locale.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 char *entries;
 
@@ -15,53 +31,119 @@ void (*add_entry)(void *, const char *key, uint32_t value);
 
 #define BYTES_PER_STRING 8
 
+/* Keys for options that only have a long form */
+enum {
+	OPTION_V3 = 0x100,
+	OPTION_CHAINS,
+	OPTION_MIXED,
+	OPTION_STRIPES,
+	OPTION_SLAB,
+	OPTION_BATCH,
+	OPTION_COLLISIONS,
+	OPTION_HASH,
+	OPTION_HASH_BENCH,
+	OPTION_PIN,
+	OPTION_FIRST_TOUCH,
+	OPTION_LOCKFREE,
+	OPTION_SHARDED,
+	OPTION_CHURN,
+	OPTION_OWN_KEYS,
+	OPTION_CLEAR,
+	OPTION_LOOKUPS,
+	OPTION_KEY_LENGTH,
+	OPTION_KEY_PREFIX,
+	OPTION_KEYS,
+	OPTION_CUCKOO,
+	OPTION_VALUES,
+	OPTION_SNAPSHOT,
+	OPTION_ITERATE,
+	OPTION_RCU,
+	OPTION_LOCK,
+	OPTION_MISSES,
+};
+
 struct arguments {
 	uint32_t threads;
 	uint32_t size;
+	bool v3;
+	bool chains;
+	bool mixed;
+	bool stripes;
+	bool slab;
+	uint32_t batch;
+	bool collisions;
+	bool hash_bench;
+	bool pin;
+	bool first_touch;
+	bool lockfree;
+	bool sharded;
+	bool churn;
+	bool own_keys;
+	bool clear;
+	bool lookups;
+	uint32_t min_key_length;
+	uint32_t max_key_length;
+	uint32_t key_prefix;
+	const char *keys_file;
+	bool cuckoo;
+	bool values;
+	const char *snapshot_file;
+	bool iterate;
+	bool rcu;
+	bool misses;
 };
 
 static struct argp_option options[] = { 
 	{ "threads", 't', "NUM", 0, "Number of threads."},
 	{ "size", 's', "NUM", 0, "Size per thread."},
+	{ "v3", OPTION_V3, 0, 0, "Also run the open-addressing v3 table."},
+	{ "chains", OPTION_CHAINS, 0, 0, "Report chain lengths with and without resizing."},
+	{ "mixed", OPTION_MIXED, 0, 0, "Check v2 lookups while other threads insert."},
+	{ "stripes", OPTION_STRIPES, 0, 0, "Sweep the number of v2 lock stripes."},
+	{ "slab", OPTION_SLAB, 0, 0, "Compare node allocation with and without slabs."},
+	{ "batch", OPTION_BATCH, "NUM", 0, "Also run v2 inserting NUM keys per add_entries call."},
+	{ "collisions", OPTION_COLLISIONS, 0, 0, "Time long chains of keys sharing a prefix."},
+	{ "hash", OPTION_HASH, "NAME", 0, "Hash function for every table: djb2, wyhash or crc32c."},
+	{ "hash-bench", OPTION_HASH_BENCH, 0, 0, "Compare the speed and spread of each hash function."},
+	{ "pin", OPTION_PIN, 0, 0, "Pin each worker to its own CPU."},
+	{ "first-touch", OPTION_FIRST_TOUCH, 0, 0, "Have each worker generate its own keys, placing them on its NUMA node."},
+	{ "lockfree", OPTION_LOCKFREE, 0, 0, "Also run the lock-free table, and compare it to v2 with more threads than CPUs."},
+	{ "sharded", OPTION_SHARDED, 0, 0, "Build private per-thread base tables and merge them, against v2."},
+	{ "churn", OPTION_CHURN, 0, 0, "Insert into and remove from v2 while other threads look keys up."},
+	{ "own-keys", OPTION_OWN_KEYS, 0, 0, "Compare tables borrowing the caller's keys with tables copying them."},
+	{ "clear", OPTION_CLEAR, 0, 0, "Time v2 destroy on one and all threads, and clear and refill."},
+	{ "lookups", OPTION_LOOKUPS, 0, 0, "Look keys up from every thread at once, in every table."},
+	{ "key-length", OPTION_KEY_LENGTH, "MIN[-MAX]", 0, "Key length in bytes, uniform between MIN and MAX (7 by default)."},
+	{ "key-prefix", OPTION_KEY_PREFIX, "NUM", 0, "Start every key with the same NUM bytes."},
+	{ "keys", OPTION_KEYS, "FILE", 0, "Read keys from FILE, one per line, instead of generating them."},
+	{ "cuckoo", OPTION_CUCKOO, 0, 0, "Also run the cuckoo table, on one thread and concurrently."},
+	{ "values", OPTION_VALUES, 0, 0, "Compare uint32_t values, indexes into a payload table and payloads stored inline."},
+	{ "snapshot", OPTION_SNAPSHOT, "FILE", 0, "Save a base table to FILE, and time loading and querying it against rebuilding."},
+	{ "iterate", OPTION_ITERATE, 0, 0, "Walk v2 with a cursor while other threads insert, and time a parallel for_each."},
+	{ "rcu", OPTION_RCU, 0, 0, "Compare v2 with and without rcu on a 99.9% lookup mix."},
+	{ "lock", OPTION_LOCK, "NAME", 0, "Lock for each v2 stripe: mutex, ttas, mcs or futex."},
+	{ "misses", OPTION_MISSES, 0, 0, "Run a mostly-miss lookup mix on v2 with and without a Bloom filter."},
 	{ 0 } 
 };
 
-static uint32_t parse_uint32_t(const char *string) {
-	uint32_t current = 0;
-	uint8_t i = 0;
-	while (true) {
-		char c = string[i];
-		if (c == 0) {
-			break;
-		}
-
-		/* Definitely greater than UINT32_MAX */
-		if (i == 10) {
-			exit(EINVAL);
-		}
-
-		/* Ensure the character is a digit */
-		if (c < 0x30 || c > 0x39) {
-			exit(EINVAL);
-		}
-
-		uint8_t digit = (c - 0x30);
-
-		/* Check for overflows */
-		if (i == 9) {
-			if (current > 429496729) {
-				exit(EINVAL);
-			}
-			else if (current == 429496729 && digit > 5) {
-				exit(EINVAL);
-			}
-		}
-
-		current = current * 10 + digit;
+/* Options every table in the run is created with, --hash changes them */
+static struct hash_table_options table_options;
 
-		++i;
+static void parse_key_length(struct arguments *arguments, char *string)
+{
+	char *dash = strchr(string, '-');
+	if (dash != NULL) {
+		*dash = 0;
+		arguments->max_key_length = parse_uint32_t(dash + 1);
+	}
+	arguments->min_key_length = parse_uint32_t(string);
+	if (dash == NULL) {
+		arguments->max_key_length = arguments->min_key_length;
+	}
+	if (arguments->min_key_length == 0
+	    || arguments->min_key_length > arguments->max_key_length) {
+		exit(EINVAL);
 	}
-	return current;
 }
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
@@ -73,12 +155,99 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
 	case 's':
 		arguments->size = parse_uint32_t(arg);
 		break;
+	case OPTION_V3:
+		arguments->v3 = true;
+		break;
+	case OPTION_CHAINS:
+		arguments->chains = true;
+		break;
+	case OPTION_MIXED:
+		arguments->mixed = true;
+		break;
+	case OPTION_STRIPES:
+		arguments->stripes = true;
+		break;
+	case OPTION_SLAB:
+		arguments->slab = true;
+		break;
+	case OPTION_BATCH:
+		arguments->batch = parse_uint32_t(arg);
+		break;
+	case OPTION_COLLISIONS:
+		arguments->collisions = true;
+		break;
+	case OPTION_HASH:
+		table_options.hash_function = parse_hash_function(arg);
+		break;
+	case OPTION_HASH_BENCH:
+		arguments->hash_bench = true;
+		break;
+	case OPTION_PIN:
+		arguments->pin = true;
+		break;
+	case OPTION_FIRST_TOUCH:
+		arguments->first_touch = true;
+		break;
+	case OPTION_LOCKFREE:
+		arguments->lockfree = true;
+		break;
+	case OPTION_SHARDED:
+		arguments->sharded = true;
+		break;
+	case OPTION_CHURN:
+		arguments->churn = true;
+		break;
+	case OPTION_OWN_KEYS:
+		arguments->own_keys = true;
+		break;
+	case OPTION_CLEAR:
+		arguments->clear = true;
+		break;
+	case OPTION_LOOKUPS:
+		arguments->lookups = true;
+		break;
+	case OPTION_KEY_LENGTH:
+		parse_key_length(arguments, arg);
+		break;
+	case OPTION_KEY_PREFIX:
+		arguments->key_prefix = parse_uint32_t(arg);
+		break;
+	case OPTION_KEYS:
+		arguments->keys_file = arg;
+		break;
+	case OPTION_CUCKOO:
+		arguments->cuckoo = true;
+		break;
+	case OPTION_VALUES:
+		arguments->values = true;
+		break;
+	case OPTION_SNAPSHOT:
+		arguments->snapshot_file = arg;
+		break;
+	case OPTION_ITERATE:
+		arguments->iterate = true;
+		break;
+	case OPTION_RCU:
+		arguments->rcu = true;
+		break;
+	case OPTION_LOCK:
+		table_options.lock = parse_lock_type(arg);
+		break;
+	case OPTION_MISSES:
+		arguments->misses = true;
+		break;
 	}   
 	return 0;
 }
 
 static struct arguments arguments;
 static char *data;
+static size_t data_size;
+/* Fixed length keys sit key_bytes apart in data. Keys that vary in length, or
+   come from a file, are found through keys instead. */
+static char **keys;
+/* The longest key plus its terminator */
+static size_t key_bytes = BYTES_PER_STRING;
 
 static size_t get_global_index(uint32_t thread, uint32_t index)
 {
@@ -87,7 +256,10 @@ static size_t get_global_index(uint32_t thread, uint32_t index)
 
 static char *get_string(size_t global_index)
 {
-	return data + (global_index * BYTES_PER_STRING);
+	if (keys != NULL) {
+		return keys[global_index];
+	}
+	return data + (global_index * key_bytes);
 }
 
 static unsigned long usec_diff(struct timeval *a, struct timeval *b)
@@ -98,6 +270,225 @@ static unsigned long usec_diff(struct timeval *a, struct timeval *b)
 	return usec;
 }
 
+#ifdef __linux__
+/* The CPUs the process may run on, workers are pinned to them in order */
+static cpu_set_t allowed_cpus;
+
+static void get_worker_cpu(uint32_t thread, cpu_set_t *cpu)
+{
+	uint32_t skip = thread % CPU_COUNT(&allowed_cpus);
+	CPU_ZERO(cpu);
+	for (int i = 0; i < CPU_SETSIZE; ++i) {
+		if (CPU_ISSET(i, &allowed_cpus) && skip-- == 0) {
+			CPU_SET(i, cpu);
+			return;
+		}
+	}
+}
+#endif
+
+/* Runs count workers, passing each its index, and returns the elapsed time
+   for all of them to finish */
+static unsigned long run_thread_count(pthread_t *threads, uint32_t count,
+                                      void *(*run)(void *))
+{
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	for (uintptr_t i = 0; i < count; ++i) {
+#ifdef __linux__
+		/* Pinned through the attributes, so a worker never runs (and touches
+		   memory) anywhere but its own CPU */
+		if (arguments.pin) {
+			cpu_set_t cpu;
+			get_worker_cpu(i, &cpu);
+			int err = pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu);
+			if (err != 0) {
+				printf("pthread_attr_setaffinity_np returned %d\n", err);
+				exit(err);
+			}
+		}
+#endif
+		int err = pthread_create(&threads[i], &attr, run, (void*) i);
+		if (err != 0) {
+			printf("pthread_create returned %d\n", err);
+			exit(err);
+		}
+	}
+	pthread_attr_destroy(&attr);
+	for (uintptr_t i = 0; i < count; ++i) {
+		int err = pthread_join(threads[i], NULL);
+		if (err != 0) {
+			printf("pthread_join returned %d\n", err);
+			exit(err);
+		}
+	}
+	gettimeofday(&end, NULL);
+	return usec_diff(&start, &end);
+}
+
+/* Runs one worker per thread over its slice of the data */
+static unsigned long run_threads(pthread_t *threads, void *(*run)(void *))
+{
+	return run_thread_count(threads, arguments.threads, run);
+}
+
+/* Shared by every key with --key-prefix */
+static char *key_prefix;
+/* Where each worker's slice of generated keys starts in data, with the end
+   of the last slice at [arguments.threads] */
+static size_t *slice_offsets;
+
+/* Lengths come from their own generator, so measuring a slice and filling it
+   draw the same ones */
+static uint64_t get_length_seed(uint32_t thread)
+{
+	return splitmix64(((uint64_t) thread << 32) | 1);
+}
+
+static uint32_t next_key_length(uint64_t *state)
+{
+	uint32_t spread = arguments.max_key_length - arguments.min_key_length + 1;
+	return arguments.min_key_length + next_random(state) % spread;
+}
+
+void *run_measure(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	uint64_t state = get_length_seed(thread);
+	size_t bytes = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		bytes += arguments.key_prefix + next_key_length(&state) + 1;
+	}
+	slice_offsets[thread + 1] = bytes;
+	return NULL;
+}
+
+/* Each worker writes its own slice, so with --first-touch the kernel places
+   those pages on the worker's NUMA node */
+void *run_generate(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	uint64_t length_state = get_length_seed(thread);
+	uint64_t state = splitmix64(42 + thread);
+	char *string = data + slice_offsets[thread];
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		uint32_t length = next_key_length(&length_state);
+		memcpy(string, key_prefix, arguments.key_prefix);
+		fill_random_letters(string + arguments.key_prefix, length, &state);
+		string[arguments.key_prefix + length] = 0;
+		if (keys != NULL) {
+			keys[get_global_index(thread, j)] = string;
+		}
+		string += arguments.key_prefix + length + 1;
+	}
+	return NULL;
+}
+
+/* Sizes every slice first, so keys are packed with no room left over */
+static unsigned long generate_keys(pthread_t *threads)
+{
+	if (arguments.min_key_length == 0) {
+		arguments.min_key_length = BYTES_PER_STRING - 1;
+		arguments.max_key_length = BYTES_PER_STRING - 1;
+	}
+	key_bytes = arguments.key_prefix + arguments.max_key_length + 1;
+	if (arguments.min_key_length != arguments.max_key_length) {
+		keys = calloc((size_t) arguments.threads * arguments.size, sizeof(char *));
+		assert(keys != NULL);
+	}
+
+	/* Cycles through a URL, like keys from one site */
+	static const char url[] = "https://www.example.com/";
+	key_prefix = malloc(arguments.key_prefix + 1);
+	assert(key_prefix != NULL);
+	for (uint32_t k = 0; k < arguments.key_prefix; ++k) {
+		key_prefix[k] = url[k % (sizeof(url) - 1)];
+	}
+
+	slice_offsets = calloc(arguments.threads + 1, sizeof(size_t));
+	assert(slice_offsets != NULL);
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	run_threads(threads, run_measure);
+	for (uint32_t i = 0; i < arguments.threads; ++i) {
+		slice_offsets[i + 1] += slice_offsets[i];
+	}
+	data_size = slice_offsets[arguments.threads];
+
+	if (arguments.first_touch) {
+		/* Fresh anonymous pages, nothing touches them before the workers */
+		data = mmap(NULL, data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(data != MAP_FAILED);
+	}
+	else {
+		data = malloc(data_size);
+		assert(data != NULL);
+	}
+	run_threads(threads, run_generate);
+	gettimeofday(&end, NULL);
+	return usec_diff(&start, &end);
+}
+
+/* Maps FILE and uses its first threads * size non-empty lines as keys, in
+   place. The mapping is private, so ending each line with a terminator only
+   copies the pages it writes to, never the file. */
+static unsigned long load_keys(const char *path)
+{
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	int fd = open(path, O_RDONLY);
+	struct stat file_stat;
+	if (fd < 0 || fstat(fd, &file_stat) != 0) {
+		printf("Could not open %s: %s\n", path, strerror(errno));
+		exit(errno);
+	}
+
+	/* A byte past the end of the file terminates a last line with no
+	   newline. It comes from an anonymous mapping the file is mapped over,
+	   since a page past the end of a file cannot be touched. */
+	data_size = file_stat.st_size + 1;
+	data = mmap(NULL, data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(data != MAP_FAILED);
+	if (file_stat.st_size > 0
+	    && mmap(data, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		printf("Could not map %s: %s\n", path, strerror(errno));
+		exit(errno);
+	}
+	close(fd);
+
+	size_t count = (size_t) arguments.threads * arguments.size;
+	keys = calloc(count, sizeof(char *));
+	assert(keys != NULL);
+	key_bytes = 1;
+	size_t loaded = 0;
+	char *end_of_data = data + file_stat.st_size;
+	for (char *line = data; line < end_of_data && loaded < count;) {
+		char *newline = memchr(line, '\n', end_of_data - line);
+		if (newline == NULL) {
+			newline = end_of_data;
+		}
+		*newline = 0;
+		size_t length = newline - line;
+		if (length > 0 && line[length - 1] == '\r') {
+			line[--length] = 0;
+		}
+		if (length > 0) {
+			keys[loaded++] = line;
+			if (length + 1 > key_bytes) {
+				key_bytes = length + 1;
+			}
+		}
+		line = newline + 1;
+	}
+	if (loaded < count) {
+		printf("%s has %'lu keys, %u threads of %'u need %'lu\n", path, loaded,
+		       arguments.threads, arguments.size, count);
+		exit(EINVAL);
+	}
+	gettimeofday(&end, NULL);
+	return usec_diff(&start, &end);
+}
+
 static struct hash_table_v1 *hash_table_v1;
 
 void *run_v1(void *arg) {
@@ -112,6 +503,33 @@ void *run_v1(void *arg) {
 
 static struct hash_table_v2 *hash_table_v2;
 
+/* Prints nothing unless v2 was built with STATS=1 */
+static void print_v2_stats(void)
+{
+	struct hash_table_v2_stats stats;
+	hash_table_v2_stats(hash_table_v2, &stats);
+	if (!stats.enabled) {
+		return;
+	}
+	double contended = stats.acquisitions ? 100.0 * stats.contended / stats.acquisitions : 0;
+	printf("  - %'lu lock acquisitions, %'lu contended (%.2f%%), %'lu usec held, max chain %'zu\n",
+	       stats.acquisitions, stats.contended, contended, stats.hold_nsec / 1000,
+	       stats.max_chain_length);
+	printf("  - %'lu lookups by nodes compared:", stats.lookups);
+	for (size_t b = 0; b < HASH_TABLE_V2_PROBE_BINS; ++b) {
+		if (stats.probe_histogram[b] > 0) {
+			printf(" %zu%s:%'lu", b, b == HASH_TABLE_V2_PROBE_BINS - 1 ? "+" : "",
+			       stats.probe_histogram[b]);
+		}
+	}
+	printf("\n  - hot stripes:");
+	for (size_t i = 0; i < stats.hot_count; ++i) {
+		printf(" %zu (%'lu, %'lu contended)", stats.hot[i].stripe,
+		       stats.hot[i].acquisitions, stats.hot[i].contended);
+	}
+	printf("\n");
+}
+
 void *run_v2(void *arg) {
 	uint32_t thread = (uintptr_t) arg;
 	for (uint32_t j = 0; j < arguments.size; ++j) {
@@ -122,134 +540,1766 @@ void *run_v2(void *arg) {
 	return NULL;
 }
 
-int main(int argc, char *argv[])
-{
-	arguments.threads = 4;
-	arguments.size = 25000;
-  
-	static struct argp argp = { options, parse_opt };
-	argp_parse(&argp, argc, argv, 0, 0, &arguments);
-
-	setlocale(LC_ALL, "en_US.UTF-8");
-
-	data = calloc(arguments.threads * arguments.size, BYTES_PER_STRING);
-
-	struct timeval start, end;
-
-	gettimeofday(&start, NULL);
-	srand(42);
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			for (uint32_t k = 0; k < (BYTES_PER_STRING - 1); ++k) {
-				int r = rand() % 52;
-				if (r < 26) {
-					string[k] = r + 0x41;
-				}
-				else {
-					string[k] = r + 0x47;
-				}
-			}
-			string[BYTES_PER_STRING - 1] = 0;
+void *run_v2_batched(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	struct hash_table_pair *pairs = calloc(arguments.batch, sizeof(struct hash_table_pair));
+	for (uint32_t j = 0; j < arguments.size; j += arguments.batch) {
+		size_t count = 0;
+		for (uint32_t k = j; k < arguments.size && count < arguments.batch; ++k) {
+			size_t global_index = get_global_index(thread, k);
+			pairs[count].key = get_string(global_index);
+			pairs[count].value = global_index;
+			++count;
 		}
+		hash_table_v2_add_entries(hash_table_v2, pairs, count);
 	}
-	gettimeofday(&end, NULL);
-	printf("Generation: %'lu usec\n", usec_diff(&start, &end));
+	free(pairs);
+	return NULL;
+}
 
-	struct hash_table_base *hash_table_base = hash_table_base_create();
-	gettimeofday(&start, NULL);
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			hash_table_base_add_entry(hash_table_base, string, global_index);
-		}
-	}
-	gettimeofday(&end, NULL);
-	printf("Hash table base: %'lu usec\n", usec_diff(&start, &end));
+static void run_batched(pthread_t *threads)
+{
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	printf("Hash table v2 batched (%'u per batch): %'lu usec\n",
+	       arguments.batch, run_threads(threads, run_v2_batched));
 
 	size_t missing = 0;
 	for (uint32_t i = 0; i < arguments.threads; ++i) {
 		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			if (!hash_table_base_contains(hash_table_base, string)) {
+			char *string = get_string(get_global_index(i, j));
+			if (!hash_table_v2_contains(hash_table_v2, string)) {
 				++missing;
 			}
 		}
 	}
 	printf("  - %'lu missing\n", missing);
-	hash_table_base_destroy(hash_table_base);
+	print_v2_stats();
+	hash_table_v2_destroy(hash_table_v2);
+}
 
-	pthread_t *threads = calloc(arguments.threads, sizeof(pthread_t));
+/* Keys for --collisions share a long prefix, so every strcmp against a
+   different key in the same chain runs past it before failing */
+#define COLLISION_PREFIX "collision-heavy-shared-key-prefix-"
+#define COLLISION_BYTES_PER_STRING (sizeof(COLLISION_PREFIX) + BYTES_PER_STRING)
+
+static char *collision_data;
+
+static char *get_collision_string(size_t global_index)
+{
+	return collision_data + (global_index * COLLISION_BYTES_PER_STRING);
+}
+
+void *run_v2_collisions(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_collision_string(global_index);
+		hash_table_v2_add_entry(hash_table_v2, string, global_index);
+	}
+	return NULL;
+}
 
-	hash_table_v1 = hash_table_v1_create();
+/* Inserts every collision key into a fresh base table and looks each one up,
+   adding the lookups that failed to *missing */
+static void time_base_collisions(const struct hash_table_options *options,
+                                 unsigned long *insert,
+                                 unsigned long *lookup,
+                                 size_t *missing)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	struct timeval start, end;
+	struct hash_table_base *hash_table_base = hash_table_base_create_with_options(options);
 	gettimeofday(&start, NULL);
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_create(&threads[i], NULL, run_v1, (void*) i);
-		if (err != 0) {
-			printf("pthread_create returned %d\n", err);
-			return err;
+	for (size_t i = 0; i < count; ++i) {
+		hash_table_base_add_entry(hash_table_base, get_collision_string(i), i);
+	}
+	gettimeofday(&end, NULL);
+	*insert = usec_diff(&start, &end);
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < count; ++i) {
+		if (!hash_table_base_contains(hash_table_base, get_collision_string(i))) {
+			++*missing;
 		}
 	}
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_join(threads[i], NULL);
-		if (err != 0) {
-			printf("pthread_join returned %d\n", err);
-			return err;
+	gettimeofday(&end, NULL);
+	*lookup = usec_diff(&start, &end);
+	hash_table_base_destroy(hash_table_base);
+}
+
+/* The same for v2, inserting from every thread */
+static void time_v2_collisions(pthread_t *threads,
+                               const struct hash_table_options *options,
+                               unsigned long *insert,
+                               unsigned long *lookup,
+                               size_t *missing)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	struct timeval start, end;
+	hash_table_v2 = hash_table_v2_create_with_options(options);
+	*insert = run_threads(threads, run_v2_collisions);
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < count; ++i) {
+		if (!hash_table_v2_contains(hash_table_v2, get_collision_string(i))) {
+			++*missing;
 		}
 	}
 	gettimeofday(&end, NULL);
-	printf("Hash table v1: %'lu usec\n", usec_diff(&start, &end));
+	*lookup = usec_diff(&start, &end);
+	hash_table_v2_destroy(hash_table_v2);
+}
 
-	missing = 0;
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			if (!hash_table_v1_contains(hash_table_v1, string)) {
-				++missing;
-			}
+/* Tables are kept at HASH_TABLE_CAPACITY buckets so chains get long, which
+   is where comparing cached hashes before keys pays off. Each table is timed
+   again with skip_hash_check as the baseline, where every node in a chain
+   costs a strcmp through the shared prefix. */
+static void run_collisions(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	collision_data = calloc(count, COLLISION_BYTES_PER_STRING);
+	unsigned int seed = 42;
+	for (size_t i = 0; i < count; ++i) {
+		char *string = get_collision_string(i);
+		memcpy(string, COLLISION_PREFIX, sizeof(COLLISION_PREFIX) - 1);
+		for (size_t k = sizeof(COLLISION_PREFIX) - 1; k < COLLISION_BYTES_PER_STRING - 1; ++k) {
+			int r = rand_r(&seed) % 52;
+			string[k] = r < 26 ? r + 0x41 : r + 0x47;
 		}
 	}
+
+	struct hash_table_options options = table_options;
+	options.max_load_factor = 0;
+	struct hash_table_options uncached = options;
+	uncached.skip_hash_check = true;
+	unsigned long insert, lookup, uncached_insert, uncached_lookup;
+
+	size_t missing = 0;
+	time_base_collisions(&options, &insert, &lookup, &missing);
+	time_base_collisions(&uncached, &uncached_insert, &uncached_lookup, &missing);
+	printf("Hash table base collisions: %'lu usec insert, %'lu usec lookup, "
+	       "against %'lu usec insert, %'lu usec lookup without the hash check\n",
+	       insert, lookup, uncached_insert, uncached_lookup);
 	printf("  - %'lu missing\n", missing);
-	hash_table_v1_destroy(hash_table_v1);
 
-	hash_table_v2 = hash_table_v2_create();
-	gettimeofday(&start, NULL);
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_create(&threads[i], NULL, run_v2, (void*) i);
-		if (err != 0) {
-			printf("pthread_create returned %d\n", err);
-			return err;
-		}
+	missing = 0;
+	time_v2_collisions(threads, &options, &insert, &lookup, &missing);
+	time_v2_collisions(threads, &uncached, &uncached_insert, &uncached_lookup, &missing);
+	printf("Hash table v2 collisions: %'lu usec insert, %'lu usec lookup, "
+	       "against %'lu usec insert, %'lu usec lookup without the hash check\n",
+	       insert, lookup, uncached_insert, uncached_lookup);
+	printf("  - %'lu missing\n", missing);
+
+	free(collision_data);
+}
+
+static atomic_size_t failed_lookups;
+
+/* A key may appear more than once in the data, so a lookup is right as long
+   as the value it returns indexes an identical string */
+static bool v2_lookup_ok(size_t global_index)
+{
+	char *string = get_string(global_index);
+	if (!hash_table_v2_contains(hash_table_v2, string)) {
+		return false;
 	}
-	for (uintptr_t i = 0; i < arguments.threads; ++i) {
-		int err = pthread_join(threads[i], NULL);
-		if (err != 0) {
-			printf("pthread_join returned %d\n", err);
-			return err;
-		}
+	uint32_t value = hash_table_v2_get_value(hash_table_v2, string);
+	return strcmp(get_string(value), string) == 0;
+}
+
+void *run_v2_first_half(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size / 2; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		hash_table_v2_add_entry(hash_table_v2, string, global_index);
 	}
-	gettimeofday(&end, NULL);
-	printf("Hash table v2: %'lu usec\n", usec_diff(&start, &end));
+	return NULL;
+}
 
-	missing = 0;
-	for (uint32_t i = 0; i < arguments.threads; ++i) {
-		for (uint32_t j = 0; j < arguments.size; ++j) {
-			size_t global_index = get_global_index(i, j);
-			char *string = get_string(global_index);
-			if (!hash_table_v2_contains(hash_table_v2, string)) {
-				++missing;
+/* Inserts the second half of this thread's slice, checking after every
+   insert both the key it just added and a random key from the first half of
+   any slice, which were all inserted before the threads started */
+void *run_v2_mixed(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	uint32_t half = arguments.size / 2;
+	unsigned int seed = thread;
+	size_t failed = 0;
+	for (uint32_t j = half; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		hash_table_v2_add_entry(hash_table_v2, string, global_index);
+		if (!v2_lookup_ok(global_index)) {
+			++failed;
+		}
+		if (half > 0) {
+			uint32_t other = rand_r(&seed) % arguments.threads;
+			if (!v2_lookup_ok(get_global_index(other, rand_r(&seed) % half))) {
+				++failed;
 			}
 		}
 	}
-	printf("  - %'lu missing\n", missing);
-	hash_table_v2_destroy(hash_table_v2);
+	atomic_fetch_add(&failed_lookups, failed);
+	return NULL;
+}
+
+static void run_mixed(pthread_t *threads)
+{
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	run_threads(threads, run_v2_first_half);
+	atomic_store(&failed_lookups, 0);
+	printf("Hash table v2 mixed: %'lu usec\n", run_threads(threads, run_v2_mixed));
+	printf("  - %'lu failed lookups\n", atomic_load(&failed_lookups));
+	print_v2_stats();
+	hash_table_v2_destroy(hash_table_v2);
+}
+
+/* Slides a window of half a slice along each thread's keys: every insert
+   from the second half removes the key half a slice behind it. In between,
+   the new key must be found, and a random key anywhere is looked up so that
+   readers keep walking chains whose nodes are being removed and reused. */
+void *run_v2_churn(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	uint32_t half = arguments.size / 2;
+	unsigned int seed = thread;
+	size_t failed = 0;
+	for (uint32_t j = half; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		hash_table_v2_add_entry(hash_table_v2, string, global_index);
+		if (!hash_table_v2_contains(hash_table_v2, string)) {
+			++failed;
+		}
+		hash_table_v2_remove(hash_table_v2, get_string(get_global_index(thread, j - half)));
+		uint32_t other = rand_r(&seed) % arguments.threads;
+		hash_table_v2_contains(hash_table_v2, get_string(get_global_index(other, rand_r(&seed) % arguments.size)));
+	}
+	atomic_fetch_add(&failed_lookups, failed);
+	return NULL;
+}
+
+static unsigned long ops_per_sec(size_t ops, unsigned long usec)
+{
+	if (usec == 0) {
+		usec = 1;
+	}
+	return ops * 1000000.0 / usec;
+}
+
+static void run_churn(pthread_t *threads)
+{
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	run_threads(threads, run_v2_first_half);
+	size_t allocations = hash_table_v2_allocations(hash_table_v2);
+	atomic_store(&failed_lookups, 0);
+	unsigned long usec = run_threads(threads, run_v2_churn);
+	/* An insert, a remove and two lookups per step */
+	size_t ops = (size_t) arguments.threads * (arguments.size - arguments.size / 2) * 4;
+	printf("Hash table v2 churn: %'lu usec, %'lu ops/sec\n", usec, ops_per_sec(ops, usec));
+	printf("  - %'lu failed lookups\n", atomic_load(&failed_lookups));
+
+	struct hash_table_chain_stats stats;
+	hash_table_v2_chain_stats(hash_table_v2, &stats);
+	printf("  - %'zu entries, %'zu allocations (%'zu before churn)\n",
+	       stats.entries, hash_table_v2_allocations(hash_table_v2), allocations);
+	print_v2_stats();
+	hash_table_v2_destroy(hash_table_v2);
+}
+
+/* A copy of the keys for --own-keys, freed before the lookups when the table
+   owns its keys */
+static char *key_copy;
+
+/* Keys are copied as one block, so each copy is as far into it as its
+   original is into data */
+static char *get_key_copy(size_t global_index)
+{
+	return key_copy + (get_string(global_index) - data);
+}
+
+void *run_v2_key_copy(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_key_copy(global_index);
+		hash_table_v2_add_entry(hash_table_v2, string, global_index);
+	}
+	return NULL;
+}
+
+static void print_key_ownership(const char *name, bool own_keys, unsigned long insert,
+                                unsigned long lookup, size_t key_bytes, size_t missing)
+{
+	printf("Hash table %s (%s keys): %'lu usec insert, %'lu usec lookup, %'zu key bytes\n",
+	       name, own_keys ? "owned" : "borrowed", insert, lookup, key_bytes);
+	printf("  - %'lu missing\n", missing);
+}
+
+/* Inserts from a copy of the keys and looks them up with the originals.
+   Borrowing tables need the copy kept alive, and its size is what their keys
+   cost. Owning tables get the copy freed before the lookups. */
+static void run_own_keys(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	size_t data_bytes = data_size;
+	struct timeval start, end;
+
+	for (int own_keys = 0; own_keys < 2; ++own_keys) {
+		struct hash_table_options options = table_options;
+		options.own_keys = own_keys;
+
+		key_copy = malloc(data_bytes);
+		assert(key_copy != NULL);
+		memcpy(key_copy, data, data_bytes);
+		struct hash_table_base *hash_table_base = hash_table_base_create_with_options(&options);
+		gettimeofday(&start, NULL);
+		for (size_t i = 0; i < count; ++i) {
+			hash_table_base_add_entry(hash_table_base, get_key_copy(i), i);
+		}
+		gettimeofday(&end, NULL);
+		unsigned long insert = usec_diff(&start, &end);
+		if (own_keys) {
+			free(key_copy);
+		}
+		size_t missing = 0;
+		gettimeofday(&start, NULL);
+		for (size_t i = 0; i < count; ++i) {
+			missing += !hash_table_base_contains(hash_table_base, get_string(i));
+		}
+		gettimeofday(&end, NULL);
+		print_key_ownership("base", own_keys, insert, usec_diff(&start, &end),
+		                    own_keys ? hash_table_base_key_bytes(hash_table_base) : data_bytes,
+		                    missing);
+		hash_table_base_destroy(hash_table_base);
+		if (!own_keys) {
+			free(key_copy);
+		}
+
+		key_copy = malloc(data_bytes);
+		assert(key_copy != NULL);
+		memcpy(key_copy, data, data_bytes);
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		insert = run_threads(threads, run_v2_key_copy);
+		if (own_keys) {
+			free(key_copy);
+		}
+		missing = 0;
+		gettimeofday(&start, NULL);
+		for (size_t i = 0; i < count; ++i) {
+			missing += !hash_table_v2_contains(hash_table_v2, get_string(i));
+		}
+		gettimeofday(&end, NULL);
+		print_key_ownership("v2", own_keys, insert, usec_diff(&start, &end),
+		                    own_keys ? hash_table_v2_key_bytes(hash_table_v2) : data_bytes,
+		                    missing);
+		hash_table_v2_destroy(hash_table_v2);
+		if (!own_keys) {
+			free(key_copy);
+		}
+	}
+}
+
+/* The payload stored under key i for --values, either inline in the
+   _payload tables or at index i of this side table */
+static struct hash_table_payload *payloads;
+
+#define PAYLOAD_WORDS (sizeof(struct hash_table_payload) / sizeof(uint32_t))
+
+static void fill_payload(struct hash_table_payload *payload, size_t global_index)
+{
+	for (size_t k = 0; k < PAYLOAD_WORDS; ++k) {
+		payload->bytes[k] = global_index + k;
+	}
+}
+
+/* Reads the whole payload, as a caller using it would */
+static bool payload_ok(const struct hash_table_payload *payload, size_t global_index)
+{
+	bool ok = true;
+	for (size_t k = 0; k < PAYLOAD_WORDS; ++k) {
+		ok &= payload->bytes[k] == (uint32_t) (global_index + k);
+	}
+	return ok;
+}
+
+static struct hash_table_v2_payload *hash_table_v2_payload;
+
+void *run_v2_payload(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		hash_table_v2_payload_add_entry(hash_table_v2_payload, string, payloads[global_index]);
+	}
+	return NULL;
+}
+
+enum value_layout {
+	VALUES_UINT32,
+	VALUES_INDEXED,
+	VALUES_INLINE,
+};
+
+static void print_values(const char *name, enum value_layout layout, unsigned long insert,
+                         unsigned long lookup, size_t wrong)
+{
+	char label[64];
+	switch (layout) {
+	case VALUES_UINT32:
+		snprintf(label, sizeof(label), "%zu-byte values", sizeof(uint32_t));
+		break;
+	case VALUES_INDEXED:
+		snprintf(label, sizeof(label), "%zu-byte index, %zu-byte payloads",
+		         sizeof(uint32_t), sizeof(struct hash_table_payload));
+		break;
+	case VALUES_INLINE:
+		snprintf(label, sizeof(label), "%zu-byte values", sizeof(struct hash_table_payload));
+		break;
+	}
+	printf("Hash table %s (%s): %'lu usec insert, %'lu usec lookup\n",
+	       name, label, insert, lookup);
+	printf("  - %'lu wrong\n", wrong);
+}
+
+/* Stores a plain uint32_t, an index into a side table of payloads, and the
+   payloads themselves in base and v2. Lookups run on one thread and read the
+   whole value, so the indexed layout pays for its second memory access. */
+static void run_values(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	struct timeval start, end;
+
+	payloads = malloc(count * sizeof(*payloads));
+	assert(payloads != NULL);
+	for (size_t i = 0; i < count; ++i) {
+		fill_payload(&payloads[i], i);
+	}
+
+	for (enum value_layout layout = VALUES_UINT32; layout <= VALUES_INLINE; ++layout) {
+		unsigned long insert;
+		size_t wrong = 0;
+		if (layout == VALUES_INLINE) {
+			struct hash_table_base_payload *hash_table_base_payload =
+				hash_table_base_payload_create_with_options(&table_options);
+			gettimeofday(&start, NULL);
+			for (size_t i = 0; i < count; ++i) {
+				hash_table_base_payload_add_entry(hash_table_base_payload, get_string(i), payloads[i]);
+			}
+			gettimeofday(&end, NULL);
+			insert = usec_diff(&start, &end);
+			gettimeofday(&start, NULL);
+			for (size_t i = 0; i < count; ++i) {
+				struct hash_table_payload value =
+					hash_table_base_payload_get_value(hash_table_base_payload, get_string(i));
+				wrong += !payload_ok(&value, i);
+			}
+			gettimeofday(&end, NULL);
+			hash_table_base_payload_destroy(hash_table_base_payload);
+		} else {
+			struct hash_table_base *hash_table_base = hash_table_base_create_with_options(&table_options);
+			gettimeofday(&start, NULL);
+			for (size_t i = 0; i < count; ++i) {
+				hash_table_base_add_entry(hash_table_base, get_string(i), i);
+			}
+			gettimeofday(&end, NULL);
+			insert = usec_diff(&start, &end);
+			gettimeofday(&start, NULL);
+			for (size_t i = 0; i < count; ++i) {
+				uint32_t value = hash_table_base_get_value(hash_table_base, get_string(i));
+				if (layout == VALUES_UINT32) {
+					wrong += value != i;
+				} else {
+					wrong += value >= count || !payload_ok(&payloads[value], i);
+				}
+			}
+			gettimeofday(&end, NULL);
+			hash_table_base_destroy(hash_table_base);
+		}
+		print_values("base", layout, insert, usec_diff(&start, &end), wrong);
+	}
+
+	for (enum value_layout layout = VALUES_UINT32; layout <= VALUES_INLINE; ++layout) {
+		unsigned long insert;
+		size_t wrong = 0;
+		if (layout == VALUES_INLINE) {
+			hash_table_v2_payload = hash_table_v2_payload_create_with_options(&table_options);
+			insert = run_threads(threads, run_v2_payload);
+			gettimeofday(&start, NULL);
+			for (size_t i = 0; i < count; ++i) {
+				struct hash_table_payload value =
+					hash_table_v2_payload_get_value(hash_table_v2_payload, get_string(i));
+				wrong += !payload_ok(&value, i);
+			}
+			gettimeofday(&end, NULL);
+			hash_table_v2_payload_destroy(hash_table_v2_payload);
+		} else {
+			hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+			insert = run_threads(threads, run_v2);
+			gettimeofday(&start, NULL);
+			for (size_t i = 0; i < count; ++i) {
+				uint32_t value = hash_table_v2_get_value(hash_table_v2, get_string(i));
+				if (layout == VALUES_UINT32) {
+					wrong += value != i;
+				} else {
+					wrong += value >= count || !payload_ok(&payloads[value], i);
+				}
+			}
+			gettimeofday(&end, NULL);
+			hash_table_v2_destroy(hash_table_v2);
+		}
+		print_values("v2", layout, insert, usec_diff(&start, &end), wrong);
+	}
+
+	free(payloads);
+}
+
+/* What a restart costs: rebuilding a base table from the keys, against
+   loading the snapshot it saved. The first lookups after a load are timed
+   separately, since they fault the snapshot in. */
+/* How --snapshot damages copies of the file it saved */
+enum corruption {
+	/* The last byte is cut off */
+	CORRUPT_TRUNCATED,
+	/* The last key's terminator is overwritten */
+	CORRUPT_UNTERMINATED,
+	/* The first bucket offset, on the cache line after the header, points
+	   far past the records */
+	CORRUPT_BUCKET,
+	CORRUPT_COUNT,
+};
+
+/* Writes damaged copies of the snapshot at path next to it, and reports how
+   many of them hash_table_base_load refused */
+static void run_corrupt_snapshots(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat file_stat;
+	if (fd < 0 || fstat(fd, &file_stat) != 0) {
+		printf("open %s returned %d\n", path, errno);
+		exit(errno);
+	}
+	size_t bytes = file_stat.st_size;
+	char *image = malloc(bytes);
+	assert(image != NULL && bytes > 128);
+	if (read(fd, image, bytes) != (ssize_t) bytes) {
+		printf("read %s returned %d\n", path, errno);
+		exit(errno);
+	}
+	close(fd);
+
+	size_t corrupt_path_bytes = strlen(path) + sizeof(".corrupt");
+	char *corrupt_path = malloc(corrupt_path_bytes);
+	assert(corrupt_path != NULL);
+	snprintf(corrupt_path, corrupt_path_bytes, "%s.corrupt", path);
+
+	size_t rejected = 0;
+	for (int corruption = 0; corruption < CORRUPT_COUNT; ++corruption) {
+		char *copy = malloc(bytes);
+		assert(copy != NULL);
+		memcpy(copy, image, bytes);
+		size_t copy_bytes = bytes;
+		if (corruption == CORRUPT_TRUNCATED) {
+			--copy_bytes;
+		}
+		else if (corruption == CORRUPT_UNTERMINATED) {
+			copy[bytes - 1] = 'x';
+		}
+		else {
+			memset(copy + 64, 0xff, sizeof(uint64_t));
+		}
+		FILE *file = fopen(corrupt_path, "wb");
+		if (file == NULL || fwrite(copy, 1, copy_bytes, file) != copy_bytes
+		    || fclose(file) != 0) {
+			printf("writing %s returned %d\n", corrupt_path, errno);
+			exit(errno);
+		}
+		free(copy);
+
+		struct hash_table_base_snapshot *snapshot = hash_table_base_load(corrupt_path);
+		if (snapshot == NULL) {
+			++rejected;
+		}
+		else {
+			hash_table_base_unload(snapshot);
+		}
+	}
+	unlink(corrupt_path);
+	printf("  - %'zu of %'d corrupt snapshots rejected\n", rejected, CORRUPT_COUNT);
+	free(corrupt_path);
+	free(image);
+}
+
+static void run_snapshot(const char *path)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	struct timeval start, end;
+
+	/* Lookups go in a random order, or the table's would walk its nodes in
+	   the order they were allocated */
+	size_t *order = malloc(count * sizeof(*order));
+	assert(order != NULL);
+	uint64_t state = splitmix64(42);
+	for (size_t i = 0; i < count; ++i) {
+		order[i] = next_random(&state) % count;
+	}
+
+	struct hash_table_base *hash_table_base = hash_table_base_create_with_options(&table_options);
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < count; ++i) {
+		hash_table_base_add_entry(hash_table_base, get_string(i), i);
+	}
+	gettimeofday(&end, NULL);
+	printf("Hash table base rebuild: %'lu usec\n", usec_diff(&start, &end));
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < count; ++i) {
+		hash_table_base_contains(hash_table_base, get_string(order[i]));
+	}
+	gettimeofday(&end, NULL);
+	printf("Hash table base lookups: %'lu usec\n", usec_diff(&start, &end));
+
+	gettimeofday(&start, NULL);
+	int err = hash_table_base_save(hash_table_base, path);
+	gettimeofday(&end, NULL);
+	if (err != 0) {
+		printf("hash_table_base_save %s returned %d\n", path, err);
+		exit(err);
+	}
+	struct stat file_stat;
+	stat(path, &file_stat);
+	printf("Hash table base save: %'lu usec, %'lu bytes\n",
+	       usec_diff(&start, &end), (unsigned long) file_stat.st_size);
+
+	gettimeofday(&start, NULL);
+	struct hash_table_base_snapshot *snapshot = hash_table_base_load(path);
+	gettimeofday(&end, NULL);
+	if (snapshot == NULL) {
+		printf("hash_table_base_load %s returned %d\n", path, errno);
+		exit(errno);
+	}
+	printf("Hash table base load: %'lu usec, %'zu entries\n",
+	       usec_diff(&start, &end), hash_table_base_snapshot_size(snapshot));
+
+	for (int pass = 0; pass < 2; ++pass) {
+		size_t missing = 0;
+		gettimeofday(&start, NULL);
+		for (size_t i = 0; i < count; ++i) {
+			missing += !hash_table_base_snapshot_contains(snapshot, get_string(order[i]));
+		}
+		gettimeofday(&end, NULL);
+		printf("Hash table base snapshot lookups (%s): %'lu usec\n",
+		       pass == 0 ? "first" : "second", usec_diff(&start, &end));
+		printf("  - %'lu missing\n", missing);
+	}
+	/* Keys may repeat, so values are checked against the table rather than
+	   against their index */
+	size_t wrong = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const char *key = get_string(i);
+		wrong += hash_table_base_snapshot_contains(snapshot, key)
+		         && hash_table_base_snapshot_get_value(snapshot, key)
+		            != hash_table_base_get_value(hash_table_base, key);
+	}
+	printf("  - %'lu wrong values\n", wrong);
+	hash_table_base_unload(snapshot);
+	hash_table_base_destroy(hash_table_base);
+	free(order);
+	run_corrupt_snapshots(path);
+}
+
+/* How many times each index was returned as a value by a walk */
+static atomic_uint *visits;
+static size_t visited;
+
+/* The cursor walks on the worker after the inserting ones, so it runs
+   against their inserts and the resizes they cause */
+void *run_v2_iterate(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	if (thread < arguments.threads) {
+		for (uint32_t j = arguments.size / 2; j < arguments.size; ++j) {
+			size_t global_index = get_global_index(thread, j);
+			char *string = get_string(global_index);
+			hash_table_v2_add_entry(hash_table_v2, string, global_index);
+		}
+		return NULL;
+	}
+
+	struct hash_table_v2_cursor cursor;
+	hash_table_v2_cursor_init(hash_table_v2, &cursor);
+	const struct hash_table_pair *pairs;
+	size_t count;
+	while (hash_table_v2_cursor_next(hash_table_v2, &cursor, &pairs, &count)) {
+		for (size_t i = 0; i < count; ++i) {
+			atomic_fetch_add_explicit(&visits[pairs[i].value], 1, memory_order_relaxed);
+		}
+		visited += count;
+	}
+	hash_table_v2_cursor_destroy(&cursor);
+	return NULL;
+}
+
+static void count_visit(const char *key, uint32_t value, size_t thread, void *arg)
+{
+	atomic_fetch_add_explicit(&visits[value], 1, memory_order_relaxed);
+}
+
+/* Keys may repeat, so only an index whose key still maps to it should have
+   been visited. With first_half set, only keys from the first half of each
+   slice are required, the rest were inserted during the walk. */
+static void print_visits(bool first_half)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	size_t missing = 0;
+	size_t duplicated = 0;
+	for (size_t i = 0; i < count; ++i) {
+		unsigned int seen = atomic_load(&visits[i]);
+		duplicated += seen > 1;
+		if (seen == 0 && (!first_half || i % arguments.size < arguments.size / 2)
+		    && hash_table_v2_get_value(hash_table_v2, get_string(i)) == i) {
+			++missing;
+		}
+	}
+	printf("  - %'lu missing\n", missing);
+	printf("  - %'lu duplicated\n", duplicated);
+}
+
+/* Walks v2 with a cursor on one thread while the workers insert the second
+   half of their slices, then times for_each_parallel over the full table on
+   one thread and on every worker */
+static void run_iterate(void)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	pthread_t *threads = calloc(arguments.threads + 1, sizeof(pthread_t));
+	visits = calloc(count, sizeof(*visits));
+	assert(threads != NULL && visits != NULL);
+
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	run_threads(threads, run_v2_first_half);
+	visited = 0;
+	unsigned long usec = run_thread_count(threads, arguments.threads + 1, run_v2_iterate);
+	printf("Hash table v2 cursor (during inserts): %'lu usec, %'zu entries\n", usec, visited);
+	print_visits(true);
+
+	uint32_t thread_counts[] = { 1, arguments.threads };
+	for (size_t t = 0; t < 2; ++t) {
+		memset(visits, 0, count * sizeof(*visits));
+		struct timeval start, end;
+		gettimeofday(&start, NULL);
+		hash_table_v2_for_each_parallel(hash_table_v2, thread_counts[t], count_visit, NULL);
+		gettimeofday(&end, NULL);
+		printf("Hash table v2 for_each (%'u threads): %'lu usec\n",
+		       thread_counts[t], usec_diff(&start, &end));
+		print_visits(false);
+	}
+	hash_table_v2_destroy(hash_table_v2);
+	free(visits);
+	free(threads);
+}
+
+/* One operation in READ_MOSTLY_PERIOD is an update */
+#define READ_MOSTLY_PERIOD 1000
+#define READ_MOSTLY_ROUNDS 10
+
+/* Each worker makes READ_MOSTLY_ROUNDS passes of its slice's size, looking up
+   random keys and now and then rewriting one of its own with the value it
+   already has, so every lookup can still be checked */
+void *run_v2_read_mostly(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t count = (size_t) arguments.threads * arguments.size;
+	uint64_t state = splitmix64(42 + thread);
+	size_t failed = 0;
+	for (size_t i = 0; i < (size_t) arguments.size * READ_MOSTLY_ROUNDS; ++i) {
+		if (i % READ_MOSTLY_PERIOD == READ_MOSTLY_PERIOD - 1) {
+			size_t global_index = get_global_index(thread, i % arguments.size);
+			hash_table_v2_add_entry(hash_table_v2, get_string(global_index), global_index);
+			continue;
+		}
+		failed += !v2_lookup_ok(next_random(&state) % count);
+	}
+	atomic_fetch_add(&failed_lookups, failed);
+	return NULL;
+}
+
+void *run_v2_payload_read_mostly(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t count = (size_t) arguments.threads * arguments.size;
+	uint64_t state = splitmix64(42 + thread);
+	size_t failed = 0;
+	for (size_t i = 0; i < (size_t) arguments.size * READ_MOSTLY_ROUNDS; ++i) {
+		if (i % READ_MOSTLY_PERIOD == READ_MOSTLY_PERIOD - 1) {
+			size_t global_index = get_global_index(thread, i % arguments.size);
+			hash_table_v2_payload_add_entry(hash_table_v2_payload, get_string(global_index),
+			                                payloads[global_index]);
+			continue;
+		}
+		size_t global_index = next_random(&state) % count;
+		char *string = get_string(global_index);
+		if (!hash_table_v2_payload_contains(hash_table_v2_payload, string)) {
+			++failed;
+			continue;
+		}
+		struct hash_table_payload value =
+			hash_table_v2_payload_get_value(hash_table_v2_payload, string);
+		failed += strcmp(get_string(value.bytes[0]), string) != 0;
+	}
+	atomic_fetch_add(&failed_lookups, failed);
+	return NULL;
+}
+
+static void print_read_mostly(const char *name, bool rcu, unsigned long usec)
+{
+	size_t ops = (size_t) arguments.threads * arguments.size * READ_MOSTLY_ROUNDS;
+	printf("Hash table %s (%s): %'lu usec, %'lu ops/sec\n",
+	       name, rcu ? "rcu" : "locked updates", usec, ops_per_sec(ops, usec));
+	printf("  - %'lu failed lookups\n", atomic_load(&failed_lookups));
+}
+
+/* A lookup-heavy mix on v2 with and without rcu, with uint32_t values and
+   with the payloads of --values, where rcu also saves readers the lock
+   libatomic takes for values that wide */
+static void run_rcu(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	payloads = malloc(count * sizeof(*payloads));
+	assert(payloads != NULL);
+	for (size_t i = 0; i < count; ++i) {
+		fill_payload(&payloads[i], i);
+	}
+
+	for (int rcu = 0; rcu < 2; ++rcu) {
+		struct hash_table_options options = table_options;
+		options.rcu = rcu;
+
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		run_threads(threads, run_v2);
+		atomic_store(&failed_lookups, 0);
+		print_read_mostly("v2", rcu, run_threads(threads, run_v2_read_mostly));
+		hash_table_v2_destroy(hash_table_v2);
+
+		hash_table_v2_payload = hash_table_v2_payload_create_with_options(&options);
+		run_threads(threads, run_v2_payload);
+		atomic_store(&failed_lookups, 0);
+		print_read_mostly("v2 payload", rcu, run_threads(threads, run_v2_payload_read_mostly));
+		hash_table_v2_payload_destroy(hash_table_v2_payload);
+	}
+	free(payloads);
+}
+
+/* One lookup in MISS_MIX_PERIOD is of a key in the table */
+#define MISS_MIX_PERIOD 10
+
+/* Every key with a newline for its first byte, laid out like data, so a
+   key's miss is as far into miss_data as the key is into data */
+static char *miss_data;
+
+static char *get_miss_string(size_t global_index)
+{
+	return miss_data + (get_string(global_index) - data);
+}
+
+/* Looks up random keys, nine in ten of them absent, counting any lookup
+   that answers wrongly */
+void *run_v2_miss_mix(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t count = (size_t) arguments.threads * arguments.size;
+	uint64_t state = splitmix64(42 + thread);
+	size_t wrong = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = next_random(&state) % count;
+		if (j % MISS_MIX_PERIOD == 0) {
+			wrong += !hash_table_v2_contains(hash_table_v2, get_string(global_index));
+		}
+		else {
+			wrong += hash_table_v2_contains(hash_table_v2, get_miss_string(global_index));
+		}
+	}
+	atomic_fetch_add(&failed_lookups, wrong);
+	return NULL;
+}
+
+/* Fills v2 without and then with a Bloom filter, times the same mostly-miss
+   mix on both, and reports how many misses the filter let through to the
+   chains. expected_entries is left at 0, so the filter has to keep up with
+   the table growing. */
+static void run_misses(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	miss_data = malloc(data_size);
+	assert(miss_data != NULL);
+	memcpy(miss_data, data, data_size);
+	for (size_t i = 0; i < count; ++i) {
+		*get_miss_string(i) = '\n';
+	}
+
+	double plain_nsec = 0;
+	for (int bloom = 0; bloom < 2; ++bloom) {
+		struct hash_table_options options = table_options;
+		options.bloom = bloom;
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		run_threads(threads, run_v2);
+
+		atomic_store(&failed_lookups, 0);
+		unsigned long usec = run_threads(threads, run_v2_miss_mix);
+		double nsec = count ? usec * 1000.0 * arguments.threads / count : 0;
+		printf("Hash table v2 misses (%s): %'lu usec, %'lu lookups/sec, %.1f nsec per lookup\n",
+		       bloom ? "bloom filter" : "no filter", usec, ops_per_sec(count, usec), nsec);
+		printf("  - %'lu wrong\n", atomic_load(&failed_lookups));
+		if (bloom) {
+			size_t passed = 0;
+			for (size_t i = 0; i < count; ++i) {
+				passed += hash_table_v2_bloom_may_contain(hash_table_v2, get_miss_string(i));
+			}
+			printf("  - %.2f%% false positives\n", count ? 100.0 * passed / count : 0);
+			printf("  - %.1f nsec saved per lookup\n", plain_nsec - nsec);
+		}
+		plain_nsec = nsec;
+		hash_table_v2_destroy(hash_table_v2);
+	}
+	free(miss_data);
+}
+
+static void run_stripes(pthread_t *threads)
+{
+	size_t inserts = (size_t) arguments.threads * arguments.size;
+	for (size_t stripes = 16; stripes <= HASH_TABLE_CAPACITY; stripes *= 4) {
+		struct hash_table_options options = table_options;
+		options.lock_stripes = stripes;
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		unsigned long usec = run_threads(threads, run_v2);
+		printf("Hash table v2 (%'zu stripes): %'lu usec, %'lu inserts/sec\n",
+		       stripes, usec, ops_per_sec(inserts, usec));
+		size_t missing = 0;
+		for (size_t i = 0; i < inserts; ++i) {
+			missing += !hash_table_v2_contains(hash_table_v2, get_string(i));
+		}
+		printf("  - %'lu missing\n", missing);
+		hash_table_v2_destroy(hash_table_v2);
+	}
+}
+
+static void print_allocations(const char *name, bool slab, unsigned long insert,
+                              unsigned long destroy, size_t allocations)
+{
+	printf("Hash table %s (%s): %'lu usec insert, %'lu usec destroy, %'zu allocations\n",
+	       name, slab ? "slab" : "calloc", insert, destroy, allocations);
+}
+
+static void run_slab(pthread_t *threads)
+{
+	struct timeval start, end;
+	for (int slab = 0; slab < 2; ++slab) {
+		struct hash_table_options options = table_options;
+		options.slab = slab;
+
+		struct hash_table_base *hash_table_base = hash_table_base_create_with_options(&options);
+		gettimeofday(&start, NULL);
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				size_t global_index = get_global_index(i, j);
+				hash_table_base_add_entry(hash_table_base, get_string(global_index), global_index);
+			}
+		}
+		gettimeofday(&end, NULL);
+		unsigned long insert = usec_diff(&start, &end);
+		size_t allocations = hash_table_base_allocations(hash_table_base);
+		gettimeofday(&start, NULL);
+		hash_table_base_destroy(hash_table_base);
+		gettimeofday(&end, NULL);
+		print_allocations("base", slab, insert, usec_diff(&start, &end), allocations);
+
+		hash_table_v1 = hash_table_v1_create_with_options(&options);
+		insert = run_threads(threads, run_v1);
+		allocations = hash_table_v1_allocations(hash_table_v1);
+		gettimeofday(&start, NULL);
+		hash_table_v1_destroy(hash_table_v1);
+		gettimeofday(&end, NULL);
+		print_allocations("v1", slab, insert, usec_diff(&start, &end), allocations);
+
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		insert = run_threads(threads, run_v2);
+		allocations = hash_table_v2_allocations(hash_table_v2);
+		gettimeofday(&start, NULL);
+		hash_table_v2_destroy(hash_table_v2);
+		gettimeofday(&end, NULL);
+		print_allocations("v2", slab, insert, usec_diff(&start, &end), allocations);
+	}
+}
+
+/* Occupancy is bucketed in quarters of the mean load, the last bin also
+   holds everything past twice the mean */
+#define HASH_BENCH_BINS 9
+
+/* Hashes every key with each function, reporting throughput and how evenly
+   the hashes spread over HASH_TABLE_CAPACITY buckets */
+static void run_hash_bench(void)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	uint32_t *loads = malloc(HASH_TABLE_CAPACITY * sizeof(uint32_t));
+	assert(loads != NULL);
+	double mean = (double) count / HASH_TABLE_CAPACITY;
+	struct timeval start, end;
+
+	for (int function = 0; function < HASH_TABLE_HASH_COUNT; ++function) {
+		memset(loads, 0, HASH_TABLE_CAPACITY * sizeof(uint32_t));
+		gettimeofday(&start, NULL);
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t hash = hash_table_hash(function, get_string(i));
+			++loads[hash & (HASH_TABLE_CAPACITY - 1)];
+		}
+		gettimeofday(&end, NULL);
+		unsigned long usec = usec_diff(&start, &end);
+
+		uint32_t min = UINT32_MAX;
+		uint32_t max = 0;
+		double variance = 0;
+		size_t bins[HASH_BENCH_BINS] = { 0 };
+		for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
+			min = loads[i] < min ? loads[i] : min;
+			max = loads[i] > max ? loads[i] : max;
+			variance += (loads[i] - mean) * (loads[i] - mean);
+			size_t bin = mean > 0 ? (size_t) (loads[i] * 4 / mean) : 0;
+			++bins[bin < HASH_BENCH_BINS ? bin : HASH_BENCH_BINS - 1];
+		}
+		/* A uniform hash gives a roughly Poisson load per bucket, whose
+		   variance equals its mean, so its dispersion is close to 1 */
+		printf("Hash %s: %'lu usec, %'lu hashes/sec\n", hash_table_hash_name(function),
+		       usec, ops_per_sec(count, usec));
+		double dispersion = mean > 0 ? variance / HASH_TABLE_CAPACITY / mean : 0;
+		printf("  - bucket load min %'u, max %'u, mean %.2f, dispersion %.2f\n",
+		       min, max, mean, dispersion);
+		printf("  - buckets by load/mean:");
+		for (size_t b = 0; b < HASH_BENCH_BINS; ++b) {
+			printf(" %s%.2f:%'zu", b == HASH_BENCH_BINS - 1 ? ">=" : "<",
+			       (b + (b < HASH_BENCH_BINS - 1)) / 4.0, bins[b]);
+		}
+		printf("\n");
+	}
+	free(loads);
+}
+
+static struct hash_table_lockfree *hash_table_lockfree;
+
+void *run_lockfree(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		hash_table_lockfree_add_entry(hash_table_lockfree, string, global_index);
+	}
+	return NULL;
+}
+
+/* The second table --lockfree alternates inserts with */
+static struct hash_table_lockfree *hash_table_lockfree_other;
+
+void *run_lockfree_alternating(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		hash_table_lockfree_add_entry(j % 2 ? hash_table_lockfree_other : hash_table_lockfree,
+		                              get_string(global_index), global_index);
+	}
+	return NULL;
+}
+
+static struct hash_table_cuckoo *hash_table_cuckoo;
+
+void *run_cuckoo(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		hash_table_cuckoo_add_entry(hash_table_cuckoo, string, global_index);
+	}
+	return NULL;
+}
+
+static void print_cuckoo_missing(void)
+{
+	size_t missing = 0;
+	for (size_t i = 0; i < (size_t) arguments.threads * arguments.size; ++i) {
+		missing += !hash_table_cuckoo_contains(hash_table_cuckoo, get_string(i));
+	}
+	printf("  - %'lu missing\n", missing);
+	printf("  - %'lu stashed\n", hash_table_cuckoo_stashed(hash_table_cuckoo));
+}
+
+/* Runs the cuckoo table on one thread like base, growing as it goes, then
+   sized up front and shared by every thread like v2 */
+static void run_cuckoo_tables(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	struct timeval start, end;
+
+	hash_table_cuckoo = hash_table_cuckoo_create_with_options(&table_options);
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < count; ++i) {
+		hash_table_cuckoo_add_entry(hash_table_cuckoo, get_string(i), i);
+	}
+	gettimeofday(&end, NULL);
+	printf("Hash table cuckoo: %'lu usec\n", usec_diff(&start, &end));
+	print_cuckoo_missing();
+	hash_table_cuckoo_destroy(hash_table_cuckoo);
+
+	struct hash_table_options options = table_options;
+	options.expected_entries = count;
+	hash_table_cuckoo = hash_table_cuckoo_create_concurrent(&options);
+	printf("Hash table cuckoo concurrent: %'lu usec\n", run_threads(threads, run_cuckoo));
+	print_cuckoo_missing();
+	hash_table_cuckoo_destroy(hash_table_cuckoo);
+}
+
+/* Workers of the oversubscribed runs split all of the data between them */
+static uint32_t range_threads;
+
+static void get_range(uint32_t thread, size_t *begin, size_t *end)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	*begin = count * thread / range_threads;
+	*end = count * (thread + 1) / range_threads;
+}
+
+void *run_v2_range(void *arg) {
+	size_t begin, end;
+	get_range((uintptr_t) arg, &begin, &end);
+	for (size_t i = begin; i < end; ++i) {
+		hash_table_v2_add_entry(hash_table_v2, get_string(i), i);
+	}
+	return NULL;
+}
+
+void *run_lockfree_range(void *arg) {
+	size_t begin, end;
+	get_range((uintptr_t) arg, &begin, &end);
+	for (size_t i = begin; i < end; ++i) {
+		hash_table_lockfree_add_entry(hash_table_lockfree, get_string(i), i);
+	}
+	return NULL;
+}
+
+/* Runs the lock-free table like v2, then inserts the same keys into both
+   with up to 8 times as many threads as CPUs. A writer preempted while
+   holding a v2 stripe blocks that stripe, a preempted lock-free writer
+   blocks nobody. */
+static void run_lockfree_tables(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	struct hash_table_options options = table_options;
+	options.expected_entries = count;
+
+	hash_table_lockfree = hash_table_lockfree_create_with_options(&options);
+	printf("Hash table lockfree: %'lu usec\n", run_threads(threads, run_lockfree));
+	size_t missing = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (!hash_table_lockfree_contains(hash_table_lockfree, get_string(i))) {
+			++missing;
+		}
+	}
+	printf("  - %'lu missing\n", missing);
+	hash_table_lockfree_destroy(hash_table_lockfree);
+
+	/* Every thread switches tables on each insert, and should still
+	   allocate from one slab per table */
+	struct hash_table_options slab_options = options;
+	slab_options.slab = true;
+	hash_table_lockfree = hash_table_lockfree_create_with_options(&slab_options);
+	hash_table_lockfree_other = hash_table_lockfree_create_with_options(&slab_options);
+	printf("Hash table lockfree alternating: %'lu usec\n",
+	       run_threads(threads, run_lockfree_alternating));
+	missing = 0;
+	for (uint32_t thread = 0; thread < arguments.threads; ++thread) {
+		for (uint32_t j = 0; j < arguments.size; ++j) {
+			size_t global_index = get_global_index(thread, j);
+			missing += !hash_table_lockfree_contains(j % 2 ? hash_table_lockfree_other : hash_table_lockfree,
+			                                         get_string(global_index));
+		}
+	}
+	printf("  - %'lu missing\n", missing);
+	printf("  - %'zu allocations\n", hash_table_lockfree_allocations(hash_table_lockfree) +
+	       hash_table_lockfree_allocations(hash_table_lockfree_other));
+	hash_table_lockfree_destroy(hash_table_lockfree_other);
+	hash_table_lockfree_destroy(hash_table_lockfree);
+
+	uint32_t cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t *range_workers = calloc(cpus * 8, sizeof(pthread_t));
+	assert(range_workers != NULL);
+	for (range_threads = cpus; range_threads <= cpus * 8; range_threads *= 2) {
+		hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+		unsigned long usec = run_thread_count(range_workers, range_threads, run_v2_range);
+		printf("Hash table v2 (%'u threads): %'lu usec, %'lu inserts/sec\n",
+		       range_threads, usec, ops_per_sec(count, usec));
+		hash_table_v2_destroy(hash_table_v2);
+
+		hash_table_lockfree = hash_table_lockfree_create_with_options(&options);
+		usec = run_thread_count(range_workers, range_threads, run_lockfree_range);
+		printf("Hash table lockfree (%'u threads): %'lu usec, %'lu inserts/sec\n",
+		       range_threads, usec, ops_per_sec(count, usec));
+		hash_table_lockfree_destroy(hash_table_lockfree);
+	}
+	free(range_workers);
+}
+
+/* For --sharded every thread owns one private base table per partition, at
+   shards[thread * arguments.threads + partition]. Partitions are picked with
+   the top bits of the hash, the base tables index buckets with the bottom
+   ones. */
+static struct hash_table_base **shards;
+static atomic_size_t sharded_missing;
+
+static uint32_t get_partition(const char *key)
+{
+	uint32_t hash = hash_table_hash(table_options.hash_function, key);
+	return ((uint64_t) hash * arguments.threads) >> 32;
+}
+
+static struct hash_table_base *get_shard(uint32_t thread, uint32_t partition)
+{
+	return shards[thread * arguments.threads + partition];
+}
+
+void *run_sharded_build(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = get_global_index(thread, j);
+		char *string = get_string(global_index);
+		hash_table_base_add_entry(get_shard(thread, get_partition(string)), string, global_index);
+	}
+	return NULL;
+}
+
+/* Federated lookups ask every thread's shard of the key's partition */
+void *run_sharded_federated_lookup(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t missing = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		char *string = get_string(get_global_index(thread, j));
+		uint32_t partition = get_partition(string);
+		bool found = false;
+		for (uint32_t t = 0; t < arguments.threads && !found; ++t) {
+			found = hash_table_base_contains(get_shard(t, partition), string);
+		}
+		missing += !found;
+	}
+	atomic_fetch_add(&sharded_missing, missing);
+	return NULL;
+}
+
+static void merge_entry(const char *key, uint32_t value, void *arg)
+{
+	hash_table_base_add_entry(arg, key, value);
+}
+
+/* Thread p merges every thread's shard of partition p into thread 0's, no
+   two merges touch the same table. Later threads win for keys that appear in
+   more than one slice. */
+void *run_sharded_merge(void *arg) {
+	uint32_t partition = (uintptr_t) arg;
+	for (uint32_t t = 1; t < arguments.threads; ++t) {
+		hash_table_base_for_each(get_shard(t, partition), merge_entry,
+		                         get_shard(0, partition));
+	}
+	return NULL;
+}
+
+/* After merging a lookup is one hash and one base table */
+void *run_sharded_merged_lookup(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t missing = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		char *string = get_string(get_global_index(thread, j));
+		missing += !hash_table_base_contains(get_shard(0, get_partition(string)), string);
+	}
+	atomic_fetch_add(&sharded_missing, missing);
+	return NULL;
+}
+
+void *run_v2_lookup(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t missing = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		missing += !hash_table_v2_contains(hash_table_v2, get_string(get_global_index(thread, j)));
+	}
+	atomic_fetch_add(&sharded_missing, missing);
+	return NULL;
+}
+
+static void print_sharded_lookup(const char *name, unsigned long usec)
+{
+	printf("Hash table %s lookup: %'lu usec\n", name, usec);
+	printf("  - %'lu missing\n", atomic_load(&sharded_missing));
+	atomic_store(&sharded_missing, 0);
+}
+
+/* Builds private tables with no locking at all, then either looks keys up
+   across them or merges them first, against building and reading one
+   shared v2 table */
+static void run_sharded(pthread_t *threads)
+{
+	size_t shard_count = (size_t) arguments.threads * arguments.threads;
+	shards = calloc(shard_count, sizeof(struct hash_table_base *));
+	assert(shards != NULL);
+	for (size_t i = 0; i < shard_count; ++i) {
+		shards[i] = hash_table_base_create_with_options(&table_options);
+	}
+	atomic_store(&sharded_missing, 0);
+
+	printf("Hash table sharded build: %'lu usec\n", run_threads(threads, run_sharded_build));
+	print_sharded_lookup("sharded federated", run_threads(threads, run_sharded_federated_lookup));
+	printf("Hash table sharded merge: %'lu usec\n", run_threads(threads, run_sharded_merge));
+	print_sharded_lookup("sharded merged", run_threads(threads, run_sharded_merged_lookup));
+
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	printf("Hash table v2 build: %'lu usec\n", run_threads(threads, run_v2));
+	print_sharded_lookup("v2", run_threads(threads, run_v2_lookup));
+	hash_table_v2_destroy(hash_table_v2);
+
+	for (size_t i = 0; i < shard_count; ++i) {
+		hash_table_base_destroy(shards[i]);
+	}
+	free(shards);
+}
+
+/* Tears a full v2 table down on one thread and on all of them, and clears
+   one and fills it again, with and without slabs */
+static void run_clear(pthread_t *threads)
+{
+	struct timeval start, end;
+	for (int slab = 1; slab >= 0; --slab) {
+		struct hash_table_options options = table_options;
+		options.slab = slab;
+		const char *name = slab ? "slab" : "calloc";
+
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		run_threads(threads, run_v2);
+		gettimeofday(&start, NULL);
+		hash_table_v2_destroy(hash_table_v2);
+		gettimeofday(&end, NULL);
+		printf("Hash table v2 destroy (%s): %'lu usec\n", name, usec_diff(&start, &end));
+
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		run_threads(threads, run_v2);
+		gettimeofday(&start, NULL);
+		hash_table_v2_destroy_parallel(hash_table_v2, arguments.threads);
+		gettimeofday(&end, NULL);
+		printf("Hash table v2 destroy (%s, %'u threads): %'lu usec\n", name,
+		       arguments.threads, usec_diff(&start, &end));
+
+		hash_table_v2 = hash_table_v2_create_with_options(&options);
+		unsigned long fill = run_threads(threads, run_v2);
+		gettimeofday(&start, NULL);
+		hash_table_v2_clear(hash_table_v2);
+		gettimeofday(&end, NULL);
+		unsigned long clear = usec_diff(&start, &end);
+		unsigned long refill = run_threads(threads, run_v2);
+		printf("Hash table v2 clear (%s): %'lu usec, %'lu usec fill, %'lu usec refill\n",
+		       name, clear, fill, refill);
+		size_t missing = 0;
+		for (size_t i = 0; i < (size_t) arguments.threads * arguments.size; ++i) {
+			missing += !hash_table_v2_contains(hash_table_v2, get_string(i));
+		}
+		printf("  - %'lu missing\n", missing);
+		hash_table_v2_destroy(hash_table_v2);
+	}
+}
+
+/* For --lookups every table is read by all workers at once. Lookups never
+   modify a table, so this is safe even for base and v3. */
+struct lookup_table {
+	const char *name;
+	void *table;
+	bool (*contains)(void *table, const char *key);
+};
+
+static struct lookup_table *lookup_table;
+static atomic_size_t lookup_failures;
+
+static bool base_contains(void *table, const char *key)
+{
+	return hash_table_base_contains(table, key);
+}
+
+static bool v1_contains(void *table, const char *key)
+{
+	return hash_table_v1_contains(table, key);
+}
+
+static bool v2_contains(void *table, const char *key)
+{
+	return hash_table_v2_contains(table, key);
+}
+
+static bool v3_contains(void *table, const char *key)
+{
+	return hash_table_v3_contains(table, key);
+}
+
+static bool lockfree_contains(void *table, const char *key)
+{
+	return hash_table_lockfree_contains(table, key);
+}
+
+static bool cuckoo_contains(void *table, const char *key)
+{
+	return hash_table_cuckoo_contains(table, key);
+}
+
+/* Each worker checks the keys it would have inserted */
+void *run_lookup_own(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t missing = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		char *string = get_string(get_global_index(thread, j));
+		missing += !lookup_table->contains(lookup_table->table, string);
+	}
+	atomic_fetch_add(&lookup_failures, missing);
+	return NULL;
+}
+
+/* Each worker looks up as many keys as it owns, picked from all slices */
+void *run_lookup_random(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	unsigned int seed = 42 + thread;
+	size_t count = (size_t) arguments.threads * arguments.size;
+	size_t missing = 0;
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		size_t global_index = ((size_t) rand_r(&seed) * (RAND_MAX + 1ul) + rand_r(&seed)) % count;
+		missing += !lookup_table->contains(lookup_table->table, get_string(global_index));
+	}
+	atomic_fetch_add(&lookup_failures, missing);
+	return NULL;
+}
+
+/* No key has a newline in it, generated or read from a file, so starting a
+   key with one makes a key that is never in the table */
+void *run_lookup_misses(void *arg) {
+	uint32_t thread = (uintptr_t) arg;
+	size_t found = 0;
+	char *string = malloc(key_bytes);
+	assert(string != NULL);
+	for (uint32_t j = 0; j < arguments.size; ++j) {
+		strcpy(string, get_string(get_global_index(thread, j)));
+		string[0] = '\n';
+		found += lookup_table->contains(lookup_table->table, string);
+	}
+	free(string);
+	atomic_fetch_add(&lookup_failures, found);
+	return NULL;
+}
+
+static void print_lookups(pthread_t *threads, const char *phase,
+                          void *(*run)(void *), const char *failure)
+{
+	atomic_store(&lookup_failures, 0);
+	unsigned long usec = run_threads(threads, run);
+	printf("Hash table %s lookups (%s): %'lu usec, %'lu lookups/sec\n",
+	       lookup_table->name, phase, usec,
+	       ops_per_sec((size_t) arguments.threads * arguments.size, usec));
+	printf("  - %'lu %s\n", atomic_load(&lookup_failures), failure);
+}
+
+static void run_lookup_phases(pthread_t *threads, struct lookup_table *table)
+{
+	lookup_table = table;
+	print_lookups(threads, "own slice", run_lookup_own, "missing");
+	print_lookups(threads, "random hits", run_lookup_random, "missing");
+	print_lookups(threads, "misses", run_lookup_misses, "found");
+}
+
+/* Builds every table the way the main run does, and cuckoo as a concurrent
+   table, then times the same three lookup phases on each with all workers
+   reading at once */
+static void run_lookups(pthread_t *threads)
+{
+	size_t count = (size_t) arguments.threads * arguments.size;
+	struct timeval start, end;
+
+	struct hash_table_base *hash_table_base = hash_table_base_create_with_options(&table_options);
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < count; ++i) {
+		hash_table_base_add_entry(hash_table_base, get_string(i), i);
+	}
+	gettimeofday(&end, NULL);
+	printf("Hash table base build: %'lu usec\n", usec_diff(&start, &end));
+	run_lookup_phases(threads, &(struct lookup_table) { "base", hash_table_base, base_contains });
+	hash_table_base_destroy(hash_table_base);
+
+	hash_table_v1 = hash_table_v1_create_with_options(&table_options);
+	printf("Hash table v1 build: %'lu usec\n", run_threads(threads, run_v1));
+	run_lookup_phases(threads, &(struct lookup_table) { "v1", hash_table_v1, v1_contains });
+	hash_table_v1_destroy(hash_table_v1);
+
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	printf("Hash table v2 build: %'lu usec\n", run_threads(threads, run_v2));
+	run_lookup_phases(threads, &(struct lookup_table) { "v2", hash_table_v2, v2_contains });
+	print_v2_stats();
+	hash_table_v2_destroy(hash_table_v2);
+
+	struct hash_table_v3 *hash_table_v3 = hash_table_v3_create_with_options(&table_options);
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < count; ++i) {
+		hash_table_v3_add_entry(hash_table_v3, get_string(i), i);
+	}
+	gettimeofday(&end, NULL);
+	printf("Hash table v3 build: %'lu usec\n", usec_diff(&start, &end));
+	run_lookup_phases(threads, &(struct lookup_table) { "v3", hash_table_v3, v3_contains });
+	hash_table_v3_destroy(hash_table_v3);
+
+	struct hash_table_options options = table_options;
+	options.expected_entries = count;
+	hash_table_lockfree = hash_table_lockfree_create_with_options(&options);
+	printf("Hash table lockfree build: %'lu usec\n", run_threads(threads, run_lockfree));
+	run_lookup_phases(threads, &(struct lookup_table) { "lockfree", hash_table_lockfree, lockfree_contains });
+	hash_table_lockfree_destroy(hash_table_lockfree);
+
+	hash_table_cuckoo = hash_table_cuckoo_create_concurrent(&options);
+	printf("Hash table cuckoo build: %'lu usec\n", run_threads(threads, run_cuckoo));
+	run_lookup_phases(threads, &(struct lookup_table) { "cuckoo", hash_table_cuckoo, cuckoo_contains });
+	hash_table_cuckoo_destroy(hash_table_cuckoo);
+}
+
+static void print_chain_stats(const char *name,
+                              struct hash_table_chain_stats *stats)
+{
+	double mean = 0;
+	if (stats->used_buckets > 0) {
+		mean = (double) stats->entries / stats->used_buckets;
+	}
+	printf("Chain lengths %s: %'zu buckets, max %'zu, mean %.2f\n",
+	       name, stats->buckets, stats->max_length, mean);
+}
+
+/* Fills base and v2 tables once with growth disabled and once with the
+   default load factor, and reports how long their chains get */
+static void run_chains(pthread_t *threads)
+{
+	struct hash_table_options fixed = table_options;
+	fixed.max_load_factor = 0;
+	const struct hash_table_options *variants[] = { &fixed, &table_options };
+	const char *names[][2] = {
+		{ "base (fixed)", "base (resized)" },
+		{ "v2 (fixed)", "v2 (resized)" },
+	};
+
+	for (size_t v = 0; v < 2; ++v) {
+		struct hash_table_chain_stats stats;
+		struct hash_table_base *hash_table_base = hash_table_base_create_with_options(variants[v]);
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				size_t global_index = get_global_index(i, j);
+				hash_table_base_add_entry(hash_table_base, get_string(global_index), global_index);
+			}
+		}
+		hash_table_base_chain_stats(hash_table_base, &stats);
+		print_chain_stats(names[0][v], &stats);
+		hash_table_base_destroy(hash_table_base);
+	}
+
+	for (size_t v = 0; v < 2; ++v) {
+		struct hash_table_chain_stats stats;
+		hash_table_v2 = hash_table_v2_create_with_options(variants[v]);
+		run_threads(threads, run_v2);
+		hash_table_v2_chain_stats(hash_table_v2, &stats);
+		print_chain_stats(names[1][v], &stats);
+		hash_table_v2_destroy(hash_table_v2);
+	}
+
+	/* Half of every slice, and then the same number of keys after churning
+	   through the rest, which should not need any more buckets */
+	struct hash_table_chain_stats stats;
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	run_threads(threads, run_v2_first_half);
+	hash_table_v2_chain_stats(hash_table_v2, &stats);
+	print_chain_stats("v2 (half)", &stats);
+	run_threads(threads, run_v2_churn);
+	hash_table_v2_chain_stats(hash_table_v2, &stats);
+	print_chain_stats("v2 (churned)", &stats);
+	hash_table_v2_destroy(hash_table_v2);
+}
+
+int main(int argc, char *argv[])
+{
+	arguments.threads = 4;
+	arguments.size = 25000;
+	table_options = hash_table_default_options;
+  
+	static struct argp argp = { options, parse_opt };
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	setlocale(LC_ALL, "en_US.UTF-8");
+
+#ifdef __linux__
+	if (arguments.pin && sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) != 0) {
+		printf("sched_getaffinity returned %d\n", errno);
+		exit(errno);
+	}
+#else
+	/* Only Linux lets a thread be created already pinned */
+	if (arguments.pin) {
+		printf("--pin is not supported on this platform\n");
+		exit(ENOTSUP);
+	}
+#endif
+
+	pthread_t *threads = calloc(arguments.threads, sizeof(pthread_t));
+	struct timeval start, end;
+
+	if (arguments.keys_file != NULL) {
+		printf("Generation: %'lu usec\n", load_keys(arguments.keys_file));
+	}
+	else {
+		printf("Generation: %'lu usec\n", generate_keys(threads));
+	}
+
+	struct hash_table_base *hash_table_base = hash_table_base_create_with_options(&table_options);
+	gettimeofday(&start, NULL);
+	for (uint32_t i = 0; i < arguments.threads; ++i) {
+		for (uint32_t j = 0; j < arguments.size; ++j) {
+			size_t global_index = get_global_index(i, j);
+			char *string = get_string(global_index);
+			hash_table_base_add_entry(hash_table_base, string, global_index);
+		}
+	}
+	gettimeofday(&end, NULL);
+	printf("Hash table base: %'lu usec\n", usec_diff(&start, &end));
+
+	size_t missing = 0;
+	for (uint32_t i = 0; i < arguments.threads; ++i) {
+		for (uint32_t j = 0; j < arguments.size; ++j) {
+			size_t global_index = get_global_index(i, j);
+			char *string = get_string(global_index);
+			if (!hash_table_base_contains(hash_table_base, string)) {
+				++missing;
+			}
+		}
+	}
+	printf("  - %'lu missing\n", missing);
+	hash_table_base_destroy(hash_table_base);
+
+	hash_table_v1 = hash_table_v1_create_with_options(&table_options);
+	printf("Hash table v1: %'lu usec\n", run_threads(threads, run_v1));
+
+	missing = 0;
+	for (uint32_t i = 0; i < arguments.threads; ++i) {
+		for (uint32_t j = 0; j < arguments.size; ++j) {
+			size_t global_index = get_global_index(i, j);
+			char *string = get_string(global_index);
+			if (!hash_table_v1_contains(hash_table_v1, string)) {
+				++missing;
+			}
+		}
+	}
+	printf("  - %'lu missing\n", missing);
+	hash_table_v1_destroy(hash_table_v1);
+
+	hash_table_v2 = hash_table_v2_create_with_options(&table_options);
+	printf("Hash table v2: %'lu usec\n", run_threads(threads, run_v2));
+
+	missing = 0;
+	for (uint32_t i = 0; i < arguments.threads; ++i) {
+		for (uint32_t j = 0; j < arguments.size; ++j) {
+			size_t global_index = get_global_index(i, j);
+			char *string = get_string(global_index);
+			if (!hash_table_v2_contains(hash_table_v2, string)) {
+				++missing;
+			}
+		}
+	}
+	printf("  - %'lu missing\n", missing);
+	print_v2_stats();
+	hash_table_v2_destroy(hash_table_v2);
+
+	if (arguments.v3) {
+		struct hash_table_v3 *hash_table_v3 = hash_table_v3_create_with_options(&table_options);
+		gettimeofday(&start, NULL);
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				size_t global_index = get_global_index(i, j);
+				char *string = get_string(global_index);
+				hash_table_v3_add_entry(hash_table_v3, string, global_index);
+			}
+		}
+		gettimeofday(&end, NULL);
+		printf("Hash table v3: %'lu usec\n", usec_diff(&start, &end));
+
+		missing = 0;
+		for (uint32_t i = 0; i < arguments.threads; ++i) {
+			for (uint32_t j = 0; j < arguments.size; ++j) {
+				size_t global_index = get_global_index(i, j);
+				char *string = get_string(global_index);
+				if (!hash_table_v3_contains(hash_table_v3, string)) {
+					++missing;
+				}
+			}
+		}
+		printf("  - %'lu missing\n", missing);
+		hash_table_v3_destroy(hash_table_v3);
+	}
+
+	if (arguments.chains) {
+		run_chains(threads);
+	}
+	if (arguments.mixed) {
+		run_mixed(threads);
+	}
+	if (arguments.stripes) {
+		run_stripes(threads);
+	}
+	if (arguments.slab) {
+		run_slab(threads);
+	}
+	if (arguments.batch > 0) {
+		run_batched(threads);
+	}
+	if (arguments.collisions) {
+		run_collisions(threads);
+	}
+	if (arguments.hash_bench) {
+		run_hash_bench();
+	}
+	if (arguments.lockfree) {
+		run_lockfree_tables(threads);
+	}
+	if (arguments.sharded) {
+		run_sharded(threads);
+	}
+	if (arguments.churn) {
+		run_churn(threads);
+	}
+	if (arguments.own_keys) {
+		run_own_keys(threads);
+	}
+	if (arguments.clear) {
+		run_clear(threads);
+	}
+	if (arguments.cuckoo) {
+		run_cuckoo_tables(threads);
+	}
+	if (arguments.values) {
+		run_values(threads);
+	}
+	if (arguments.snapshot_file != NULL) {
+		run_snapshot(arguments.snapshot_file);
+	}
+	if (arguments.iterate) {
+		run_iterate();
+	}
+	if (arguments.rcu) {
+		run_rcu(threads);
+	}
+	if (arguments.misses) {
+		run_misses(threads);
+	}
+	if (arguments.lookups) {
+		run_lookups(threads);
+	}
 
 	free(threads);
-	free(data);
+	if (arguments.keys_file != NULL || arguments.first_touch) {
+		munmap(data, data_size);
+	}
+	else {
+		free(data);
+	}
+	free(keys);
+	free(key_prefix);
+	free(slice_offsets);
 
 	return 0;
 }
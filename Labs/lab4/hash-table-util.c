@@ -0,0 +1,91 @@
+#include "hash-table-util.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t parse_uint32_t(const char *string) {
+	uint32_t current = 0;
+	uint8_t i = 0;
+	while (true) {
+		char c = string[i];
+		if (c == 0) {
+			break;
+		}
+
+		/* Definitely greater than UINT32_MAX */
+		if (i == 10) {
+			exit(EINVAL);
+		}
+
+		/* Ensure the character is a digit */
+		if (c < 0x30 || c > 0x39) {
+			exit(EINVAL);
+		}
+
+		uint8_t digit = (c - 0x30);
+
+		/* Check for overflows */
+		if (i == 9) {
+			if (current > 429496729) {
+				exit(EINVAL);
+			}
+			else if (current == 429496729 && digit > 5) {
+				exit(EINVAL);
+			}
+		}
+
+		current = current * 10 + digit;
+
+		++i;
+	}
+	return current;
+}
+
+enum hash_table_hash_function parse_hash_function(const char *string)
+{
+	for (int i = 0; i < HASH_TABLE_HASH_COUNT; ++i) {
+		if (strcmp(string, hash_table_hash_name(i)) == 0) {
+			return i;
+		}
+	}
+	exit(EINVAL);
+}
+
+enum hash_table_lock_type parse_lock_type(const char *string)
+{
+	for (int i = 0; i < HASH_TABLE_LOCK_COUNT; ++i) {
+		if (strcmp(string, hash_table_lock_name(i)) == 0) {
+			return i;
+		}
+	}
+	exit(EINVAL);
+}
+
+uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+/* xorshift64*, rand() takes a lock and is the bulk of generating 10M keys,
+   and this is cheap enough not to show up in per-op latencies */
+uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545f4914f6cdd1dull;
+}
+
+void fill_random_letters(char *string, size_t length, uint64_t *state)
+{
+	for (size_t k = 0; k < length; ++k) {
+		int r = next_random(state) % 52;
+		string[k] = r < 26 ? r + 0x41 : r + 0x47;
+	}
+}
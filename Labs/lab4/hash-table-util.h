@@ -0,0 +1,18 @@
+#pragma once
+
+#include "hash-table-common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Helpers the tester and the benchmark share, so both parse their options
+   and generate their keys the same way. Invalid arguments exit with EINVAL. */
+
+uint32_t parse_uint32_t(const char *string);
+enum hash_table_hash_function parse_hash_function(const char *string);
+enum hash_table_lock_type parse_lock_type(const char *string);
+
+uint64_t splitmix64(uint64_t x);
+uint64_t next_random(uint64_t *state);
+/* Writes length random upper and lower case letters, without a terminator */
+void fill_random_letters(char *string, size_t length, uint64_t *state);
@@ -1,4 +1,5 @@
-#include "hash-table-base.h"
+#include "hash-table-v1.h"
+#include "hash-table-slab.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -10,6 +11,8 @@
 
 struct list_entry {
 	const char *key;
+	/* The full hash of key, so most mismatches skip the strcmp */
+	uint32_t hash;
 	uint32_t value;
 	SLIST_ENTRY(list_entry) pointers;
 };
@@ -23,9 +26,12 @@ struct hash_table_entry {
 struct hash_table_v1 {
 	struct hash_table_entry entries[HASH_TABLE_CAPACITY];
 	pthread_mutex_t lock;
+	struct hash_table_options options;
+	/* Only used with lock held */
+	struct hash_table_slab slab;
 };
 
-struct hash_table_v1 *hash_table_v1_create()
+struct hash_table_v1 *hash_table_v1_create_with_options(const struct hash_table_options *options)
 {
 	struct hash_table_v1 *hash_table = calloc(1, sizeof(struct hash_table_v1));
 	assert(hash_table != NULL);
@@ -40,26 +46,33 @@ struct hash_table_v1 *hash_table_v1_create()
 		exit(ret);
 	}
 
+	hash_table->options = *options;
+	hash_table_slab_init(&hash_table->slab, sizeof(struct list_entry), options->slab);
 	return hash_table;
 }
 
+struct hash_table_v1 *hash_table_v1_create()
+{
+	return hash_table_v1_create_with_options(&hash_table_default_options);
+}
+
 static struct hash_table_entry *get_hash_table_entry(struct hash_table_v1 *hash_table,
-                                                     const char *key)
+                                                     uint32_t hash)
 {
-	assert(key != NULL);
-	uint32_t index = bernstein_hash(key) % HASH_TABLE_CAPACITY;
+	uint32_t index = hash % HASH_TABLE_CAPACITY;
 	struct hash_table_entry *entry = &hash_table->entries[index];
 	return entry;
 }
 
 static struct list_entry *get_list_entry(struct hash_table_v1 *hash_table,
                                          const char *key,
+                                         uint32_t hash,
                                          struct list_head *list_head)
 {
 	assert(key != NULL);
 	struct list_entry *entry = NULL;
 	SLIST_FOREACH(entry, list_head, pointers) {
-	  if (strcmp(entry->key, key) == 0) {
+	  if (entry->hash == hash && strcmp(entry->key, key) == 0) {
 	    return entry;
 	  }
 	}
@@ -69,9 +82,11 @@ static struct list_entry *get_list_entry(struct hash_table_v1 *hash_table,
 bool hash_table_v1_contains(struct hash_table_v1 *hash_table,
                             const char *key)
 {
-	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, hash);
 	struct list_head *list_head = &hash_table_entry->list_head;
-	struct list_entry *list_entry = get_list_entry(hash_table, key, list_head);
+	struct list_entry *list_entry = get_list_entry(hash_table, key, hash, list_head);
 	return list_entry != NULL;
 }
 
@@ -79,14 +94,17 @@ void hash_table_v1_add_entry(struct hash_table_v1 *hash_table,
                              const char *key,
                              uint32_t value)
 {
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+
     int ret;
     if ((ret = pthread_mutex_lock(&hash_table->lock)) != 0) {
         exit(ret);
     }
 
-	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
+	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, hash);
 	struct list_head *list_head = &hash_table_entry->list_head;
-	struct list_entry *list_entry = get_list_entry(hash_table, key, list_head);
+	struct list_entry *list_entry = get_list_entry(hash_table, key, hash, list_head);
 
 	if (list_entry != NULL) {
 		list_entry->value = value;
@@ -96,8 +114,9 @@ void hash_table_v1_add_entry(struct hash_table_v1 *hash_table,
 		return;
 	}
 
-	list_entry = calloc(1, sizeof(struct list_entry));
+	list_entry = hash_table_slab_alloc(&hash_table->slab);
 	list_entry->key = key;
+	list_entry->hash = hash;
 	list_entry->value = value;
 	SLIST_INSERT_HEAD(list_head, list_entry, pointers);
 
@@ -109,13 +128,20 @@ void hash_table_v1_add_entry(struct hash_table_v1 *hash_table,
 uint32_t hash_table_v1_get_value(struct hash_table_v1 *hash_table,
                                  const char *key)
 {
-	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, key);
+	assert(key != NULL);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+	struct hash_table_entry *hash_table_entry = get_hash_table_entry(hash_table, hash);
 	struct list_head *list_head = &hash_table_entry->list_head;
-	struct list_entry *list_entry = get_list_entry(hash_table, key, list_head);
+	struct list_entry *list_entry = get_list_entry(hash_table, key, hash, list_head);
 	assert(list_entry != NULL);
 	return list_entry->value;
 }
 
+size_t hash_table_v1_allocations(struct hash_table_v1 *hash_table)
+{
+	return hash_table->slab.allocations;
+}
+
 void hash_table_v1_destroy(struct hash_table_v1 *hash_table)
 {
 	int ret;
@@ -124,7 +150,8 @@ void hash_table_v1_destroy(struct hash_table_v1 *hash_table)
         exit(ret);
 	}
 
-	for (size_t i = 0; i < HASH_TABLE_CAPACITY; ++i) {
+	/* Slab nodes are released together with their chunks */
+	for (size_t i = 0; i < HASH_TABLE_CAPACITY && !hash_table->options.slab; ++i) {
 		struct hash_table_entry *entry = &hash_table->entries[i];
 		struct list_head *list_head = &entry->list_head;
 		struct list_entry *list_entry = NULL;
@@ -142,5 +169,6 @@ void hash_table_v1_destroy(struct hash_table_v1 *hash_table)
         exit(ret);
 	}
 
+	hash_table_slab_destroy(&hash_table->slab);
 	free(hash_table);
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 struct hash_table_v1;
 struct hash_table_v1 *hash_table_v1_create();
+struct hash_table_v1 *hash_table_v1_create_with_options(const struct hash_table_options *options);
 void hash_table_v1_add_entry(struct hash_table_v1 *hash_table,
                              const char *key,
                              uint32_t value);
@@ -13,4 +14,5 @@ bool hash_table_v1_contains(struct hash_table_v1 *hash_table,
                             const char *key);
 uint32_t hash_table_v1_get_value(struct hash_table_v1 *hash_table,
                                  const char* key);
+size_t hash_table_v1_allocations(struct hash_table_v1 *hash_table);
 void hash_table_v1_destroy(struct hash_table_v1 *hash_table);
@@ -0,0 +1,60 @@
+// Declares a v2 table named HASH_TABLE_NAME that stores HASH_TABLE_VALUE
+// values inline in its nodes, and takes batches of HASH_TABLE_PAIR (a struct
+// with a key and a HASH_TABLE_VALUE value). Include hash-table-v2.h first for
+// the stats structs, define all three, then include this; they are undefined
+// again at the end.
+
+struct HASH_TABLE_NAME;
+struct HASH_TABLE_NAME *HASH_TABLE_FN(create)();
+struct HASH_TABLE_NAME *HASH_TABLE_FN(create_with_options)(const struct hash_table_options *options);
+void HASH_TABLE_FN(add_entry)(struct HASH_TABLE_NAME *hash_table,
+                              const char *key,
+                              HASH_TABLE_VALUE value);
+void HASH_TABLE_FN(add_entries)(struct HASH_TABLE_NAME *hash_table,
+                                const HASH_TABLE_PAIR *pairs,
+                                size_t count);
+bool HASH_TABLE_FN(contains)(struct HASH_TABLE_NAME *hash_table,
+                             const char *key);
+HASH_TABLE_VALUE HASH_TABLE_FN(get_value)(struct HASH_TABLE_NAME *hash_table,
+                                          const char* key);
+bool HASH_TABLE_FN(bloom_may_contain)(struct HASH_TABLE_NAME *hash_table,
+                                      const char *key);
+bool HASH_TABLE_FN(remove)(struct HASH_TABLE_NAME *hash_table,
+                           const char *key);
+size_t HASH_TABLE_FN(allocations)(struct HASH_TABLE_NAME *hash_table);
+size_t HASH_TABLE_FN(key_bytes)(struct HASH_TABLE_NAME *hash_table);
+void HASH_TABLE_FN(chain_stats)(struct HASH_TABLE_NAME *hash_table,
+                                struct hash_table_chain_stats *stats);
+void HASH_TABLE_FN(stats)(struct HASH_TABLE_NAME *hash_table,
+                          struct hash_table_v2_stats *stats);
+void HASH_TABLE_FN(clear)(struct HASH_TABLE_NAME *hash_table);
+void HASH_TABLE_FN(destroy_parallel)(struct HASH_TABLE_NAME *hash_table,
+                                     size_t threads);
+void HASH_TABLE_FN(destroy)(struct HASH_TABLE_NAME *hash_table);
+
+// A walk over the table a bucket at a time, which other threads may insert
+// into and remove from meanwhile. Only the table reads the fields.
+struct HASH_TABLE_FN(cursor) {
+  size_t array_capacity;
+  size_t bucket;
+  size_t end;
+  HASH_TABLE_PAIR *pairs;
+  size_t count;
+  size_t capacity;
+};
+void HASH_TABLE_FN(cursor_init)(struct HASH_TABLE_NAME *hash_table,
+                                struct HASH_TABLE_FN(cursor) *cursor);
+bool HASH_TABLE_FN(cursor_next)(struct HASH_TABLE_NAME *hash_table,
+                                struct HASH_TABLE_FN(cursor) *cursor,
+                                const HASH_TABLE_PAIR **pairs, size_t *count);
+void HASH_TABLE_FN(cursor_destroy)(struct HASH_TABLE_FN(cursor) *cursor);
+void HASH_TABLE_FN(for_each_parallel)(struct HASH_TABLE_NAME *hash_table,
+                                      size_t threads,
+                                      void (*visit)(const char *key,
+                                                    HASH_TABLE_VALUE value,
+                                                    size_t thread, void *arg),
+                                      void *arg);
+
+#undef HASH_TABLE_NAME
+#undef HASH_TABLE_VALUE
+#undef HASH_TABLE_PAIR
@@ -0,0 +1,1266 @@
+// The v2 table, for a value type chosen at compile time. A source file
+// instantiates it by defining HASH_TABLE_NAME (the prefix of the table's
+// struct and functions), HASH_TABLE_VALUE and HASH_TABLE_PAIR, then including
+// this after the declarations from hash-table-v2-decl.h. Each source file may
+// only hold one instantiation, since the helpers below are static.
+
+#include "hash-table-arena.h"
+#include "hash-table-bloom.h"
+#include "hash-table-epoch.h"
+#include "hash-table-lock.h"
+#include "hash-table-slab.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <time.h>
+
+#include <pthread.h>
+
+// Buckets each helper migrates after its own insert while a resize is running.
+#define MIGRATE_BATCH 16
+// Nodes retired across the table between attempts to advance the epoch.
+#define ADVANCE_BATCH 64
+
+struct list_entry {
+  // The caller's key, or with own_keys, where the copy in the arena of the
+  // key's stripe is.
+  union {
+    const char *key;
+    struct {
+      uint32_t offset;
+      uint32_t length;
+    } owned;
+  };
+  // The full hash of key, so most mismatches skip the strcmp. Also saves
+  // rehashing the key when its bucket is migrated.
+  uint32_t hash;
+  HASH_TABLE_VALUE value;
+  SLIST_ENTRY(list_entry) pointers;
+};
+
+SLIST_HEAD(list_head, list_entry);
+
+// Lookups take no lock. Writers fill in a node before publishing it as the
+// bucket's new head with a release store, and readers walk chains with
+// acquire loads, so a reader sees either the old head or a complete node.
+// A removed node is unlinked with its own next pointer left intact, so a
+// reader standing on it still reaches the rest of the chain. Readers walk
+// inside an epoch read section, and the node is only reused once the epoch
+// shows every reader that could have reached it has finished.
+//
+// A bucket whose chain has been copied into the next bucket array keeps the
+// old chain with this tag set in its head pointer, so readers already walking
+// it are unaffected. The old nodes are retired like removed ones, and nothing
+// new follows a tagged head.
+#define FORWARDED_TAG ((uintptr_t)1)
+
+static bool is_forwarded(struct list_entry *first) {
+  return ((uintptr_t)first & FORWARDED_TAG) != 0;
+}
+
+static struct list_entry *load_first(struct list_head *list_head) {
+  return __atomic_load_n(&SLIST_FIRST(list_head), __ATOMIC_ACQUIRE);
+}
+
+static struct list_entry *load_next(struct list_entry *list_entry) {
+  return __atomic_load_n(&SLIST_NEXT(list_entry, pointers), __ATOMIC_ACQUIRE);
+}
+
+// SLIST_INSERT_HEAD with the head written last, as a release store.
+static void publish_head(struct list_head *list_head,
+                         struct list_entry *list_entry) {
+  SLIST_NEXT(list_entry, pointers) = SLIST_FIRST(list_head);
+  __atomic_store_n(&SLIST_FIRST(list_head), list_entry, __ATOMIC_RELEASE);
+}
+
+// Locks are striped by hash % stripe count instead of living in the buckets.
+// The stripe count is a power of two no larger than any bucket array, so a
+// key keeps its stripe as the table grows, and a bucket shares its stripe
+// with both buckets it splits into. Lookups take no lock, so there is no
+// reader side to share and a plain exclusive lock is all a stripe needs, of
+// the kind options.lock picks. Stripes are padded to a cache line so that
+// writers on neighbouring stripes do not false share.
+struct lock_stripe {
+  struct hash_table_lock lock;
+  // Entries in this stripe, and the last bucket array this stripe found
+  // itself over the load factor in.
+  size_t size;
+  struct bucket_array *overfull;
+  // Nodes for this stripe's buckets, so allocating one needs no other lock.
+  struct hash_table_slab slab;
+  // With own_keys, copies of this stripe's keys. A key stays in its stripe
+  // across resizes, so its offset does too. Removing a key does not give its
+  // bytes back.
+  struct hash_table_arena keys;
+  // Nodes removed from this stripe's buckets, or left behind in a bucket
+  // that was migrated, oldest first, waiting for readers to move past them
+  // before going back to the slab.
+  struct retired_entry *retired;
+  size_t retired_count;
+  size_t retired_capacity;
+  // Set when a node retired here completed a batch, so whoever releases the
+  // lock next tries to advance the epoch.
+  bool advance_epoch;
+#ifdef HASH_TABLE_V2_STATS
+  // Written with the lock held, apart from the lookup histogram, which
+  // unlocked readers add to.
+  uint64_t acquisitions;
+  uint64_t contended;
+  uint64_t hold_nsec;
+  uint64_t locked_at;
+  atomic_uint_fast64_t probe_histogram[HASH_TABLE_V2_PROBE_BINS];
+#endif
+} __attribute__((aligned(64)));
+
+struct retired_entry {
+  struct list_entry *list_entry;
+  uint64_t epoch;
+};
+
+struct bucket_array {
+  size_t capacity;
+  // Set before any bucket is forwarded.
+  struct bucket_array *_Atomic next;
+  // Next bucket for a helper to claim, and how many have been moved.
+  atomic_size_t migrate_cursor;
+  atomic_size_t migrated;
+  // Stripes holding more than their share of max_load_factor * capacity.
+  // Once half of them do, the median and so roughly the mean load is over
+  // the limit. A single stripe's count is too noisy to decide on its own.
+  atomic_size_t overfull_stripes;
+  // Once every bucket has moved, the epoch the array was retired in and the
+  // next array retired before it. Its nodes are retired bucket by bucket as
+  // they are copied, so only the array itself waits here.
+  uint64_t retired_epoch;
+  struct bucket_array *retired;
+  // Every key ever published in this array, copies included, so most lookups
+  // of absent keys stop here. Built afresh with each array, so it is sized
+  // for as many entries as the array may hold before it is outgrown.
+  struct hash_table_bloom bloom;
+  struct list_head buckets[];
+};
+
+struct HASH_TABLE_NAME {
+  struct lock_stripe *stripes;
+  size_t stripe_count;
+  // The newest bucket array, and the one being migrated out of, if any.
+  struct bucket_array *_Atomic buckets;
+  struct bucket_array *_Atomic old_buckets;
+  // Arrays migrated out of that a reader or writer may still be in, newest
+  // first, under resize_lock.
+  struct bucket_array *retired;
+  pthread_mutex_t resize_lock;
+  struct hash_table_epoch epoch;
+  atomic_size_t retired_nodes;
+  struct hash_table_options options;
+};
+
+static void lock(pthread_mutex_t *mutex) {
+  int ret;
+  if ((ret = pthread_mutex_lock(mutex)) != 0) {
+    exit(ret);
+  }
+}
+
+static void unlock(pthread_mutex_t *mutex) {
+  int ret;
+  if ((ret = pthread_mutex_unlock(mutex)) != 0) {
+    exit(ret);
+  }
+}
+
+#ifdef HASH_TABLE_V2_STATS
+static uint64_t now_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+// With stats, a trylock first tells contended acquisitions apart.
+static void acquire_stripe(struct lock_stripe *stripe) {
+#ifdef HASH_TABLE_V2_STATS
+  bool contended = !hash_table_lock_try_acquire(&stripe->lock);
+  if (contended) {
+    hash_table_lock_acquire(&stripe->lock);
+  }
+  ++stripe->acquisitions;
+  stripe->contended += contended;
+  stripe->locked_at = now_nsec();
+#else
+  hash_table_lock_acquire(&stripe->lock);
+#endif
+}
+
+static void release_stripe(struct lock_stripe *stripe) {
+#ifdef HASH_TABLE_V2_STATS
+  stripe->hold_nsec += now_nsec() - stripe->locked_at;
+#endif
+  hash_table_lock_release(&stripe->lock);
+}
+
+// A table that grows moves on to the next array once this one averages
+// max_load_factor entries per bucket, so its filter needs no more room than
+// that. One that never grows can only go by expected_entries.
+static struct bucket_array *
+create_bucket_array(const struct hash_table_options *options, size_t capacity) {
+  struct bucket_array *array = calloc(
+      1, sizeof(struct bucket_array) + capacity * sizeof(struct list_head));
+  assert(array != NULL);
+  array->capacity = capacity;
+  for (size_t i = 0; i < capacity; ++i) {
+    SLIST_INIT(&array->buckets[i]);
+  }
+  size_t expected_entries = options->expected_entries;
+  if (options->max_load_factor > 0) {
+    expected_entries = capacity * options->max_load_factor;
+  }
+  hash_table_bloom_init(&array->bloom, expected_entries, options->bloom);
+  return array;
+}
+
+static void destroy_bucket_array(struct bucket_array *array) {
+  hash_table_bloom_destroy(&array->bloom);
+  free(array);
+}
+
+struct HASH_TABLE_NAME *
+HASH_TABLE_FN(create_with_options)(const struct hash_table_options *options) {
+  struct HASH_TABLE_NAME *hash_table = calloc(1, sizeof(struct HASH_TABLE_NAME));
+  assert(hash_table != NULL);
+
+  size_t stripe_count = options->lock_stripes;
+  if (stripe_count == 0) {
+    stripe_count = HASH_TABLE_CAPACITY;
+  }
+  assert(stripe_count <= HASH_TABLE_CAPACITY &&
+         (stripe_count & (stripe_count - 1)) == 0);
+  hash_table->stripe_count = stripe_count;
+  hash_table->stripes =
+      aligned_alloc(64, stripe_count * sizeof(struct lock_stripe));
+  assert(hash_table->stripes != NULL);
+  memset(hash_table->stripes, 0, stripe_count * sizeof(struct lock_stripe));
+
+  int counter = -1;
+  int ret;
+
+  // Initialize each lock. If a lock fails, we update the counter and break.
+  for (size_t i = 0; i < stripe_count; ++i) {
+    struct lock_stripe *stripe = &hash_table->stripes[i];
+    if ((ret = hash_table_lock_init(&stripe->lock, options->lock)) != 0) {
+      counter = i;
+      break;
+    }
+    hash_table_slab_init(&stripe->slab, sizeof(struct list_entry),
+                         options->slab);
+    hash_table_arena_init(&stripe->keys);
+  }
+  if (counter == -1 &&
+      (ret = pthread_mutex_init(&hash_table->resize_lock, NULL)) != 0) {
+    counter = stripe_count;
+  }
+
+  // If a lock failed to initiate, we delete the entire table and up to counter
+  // number of locks.
+  if (counter != -1) {
+    for (size_t i = 0; i < counter; ++i) {
+      struct lock_stripe *stripe = &hash_table->stripes[i];
+      if ((ret = hash_table_lock_destroy(&stripe->lock)) != 0) {
+        exit(ret);
+      }
+    }
+    free(hash_table->stripes);
+    free(hash_table);
+    exit(ret);
+  }
+
+  atomic_init(&hash_table->buckets,
+              create_bucket_array(options, HASH_TABLE_CAPACITY));
+  atomic_init(&hash_table->old_buckets, NULL);
+  if (options->rcu) {
+    hash_table_epoch_init_asymmetric(&hash_table->epoch);
+  } else {
+    hash_table_epoch_init(&hash_table->epoch);
+  }
+  atomic_init(&hash_table->retired_nodes, 0);
+  hash_table->options = *options;
+  return hash_table;
+}
+
+struct HASH_TABLE_NAME *HASH_TABLE_FN(create)() {
+  return HASH_TABLE_FN(create_with_options)(&hash_table_default_options);
+}
+
+static uint32_t get_hash(struct HASH_TABLE_NAME *hash_table, const char *key) {
+  return hash_table_hash(hash_table->options.hash_function, key);
+}
+
+static struct lock_stripe *get_lock_stripe(struct HASH_TABLE_NAME *hash_table,
+                                           uint32_t hash) {
+  return &hash_table->stripes[hash & (hash_table->stripe_count - 1)];
+}
+
+static struct list_head *get_bucket(struct bucket_array *array,
+                                    uint32_t hash) {
+  return &array->buckets[hash & (array->capacity - 1)];
+}
+
+// Returns removed nodes to the slab, oldest first, for as long as the epoch
+// says no reader can still be on them. Only checks the epoch, which is a load.
+// The caller holds the stripe lock.
+static void reclaim(struct HASH_TABLE_NAME *hash_table,
+                    struct lock_stripe *stripe) {
+  size_t reclaimed = 0;
+  while (reclaimed < stripe->retired_count &&
+         hash_table_epoch_safe(&hash_table->epoch,
+                               stripe->retired[reclaimed].epoch)) {
+    hash_table_slab_free(&stripe->slab,
+                         stripe->retired[reclaimed].list_entry);
+    ++reclaimed;
+  }
+  if (reclaimed == 0) {
+    return;
+  }
+  stripe->retired_count -= reclaimed;
+  memmove(stripe->retired, stripe->retired + reclaimed,
+          stripe->retired_count * sizeof(struct retired_entry));
+}
+
+static void retire(struct HASH_TABLE_NAME *hash_table,
+                   struct lock_stripe *stripe, struct list_entry *list_entry) {
+  if (stripe->retired_count == stripe->retired_capacity) {
+    stripe->retired_capacity =
+        stripe->retired_capacity ? stripe->retired_capacity * 2 : 16;
+    stripe->retired =
+        realloc(stripe->retired,
+                stripe->retired_capacity * sizeof(struct retired_entry));
+    assert(stripe->retired != NULL);
+  }
+  stripe->retired[stripe->retired_count].list_entry = list_entry;
+  stripe->retired[stripe->retired_count].epoch =
+      hash_table_epoch_current(&hash_table->epoch);
+  ++stripe->retired_count;
+  // Relaxed, it only spaces out the attempts.
+  if (atomic_fetch_add_explicit(&hash_table->retired_nodes, 1,
+                                memory_order_relaxed) %
+          ADVANCE_BATCH ==
+      ADVANCE_BATCH - 1) {
+    stripe->advance_epoch = true;
+  }
+}
+
+// Frees the retired arrays no reader or writer can still be in. The caller
+// holds resize_lock.
+static void reclaim_arrays(struct HASH_TABLE_NAME *hash_table) {
+  struct bucket_array **link = &hash_table->retired;
+  while (*link != NULL) {
+    struct bucket_array *array = *link;
+    if (hash_table_epoch_safe(&hash_table->epoch, array->retired_epoch)) {
+      *link = array->retired;
+      destroy_bucket_array(array);
+    } else {
+      link = &array->retired;
+    }
+  }
+}
+
+// Advancing the epoch scans every reader and, with rcu, makes a membarrier
+// call that interrupts every CPU running the process. So it is tried once per
+// ADVANCE_BATCH retired nodes, after the stripe lock is released, rather than
+// holding up the stripe's writers on every update. An advance may also be
+// what lets a retired array go, unless a resize is busy with the list.
+static void release_stripe_and_advance(struct HASH_TABLE_NAME *hash_table,
+                                       struct lock_stripe *stripe) {
+  bool advance = stripe->advance_epoch;
+  stripe->advance_epoch = false;
+  release_stripe(stripe);
+  if (advance) {
+    hash_table_epoch_advance(&hash_table->epoch);
+    if (pthread_mutex_trylock(&hash_table->resize_lock) == 0) {
+      reclaim_arrays(hash_table);
+      unlock(&hash_table->resize_lock);
+    }
+  }
+}
+
+// Retires the array once its last bucket has been moved. Anyone who loaded it
+// as old_buckets did so inside an epoch section, so it is freed like a node,
+// two epochs after it is unpublished.
+static void finish_resize(struct HASH_TABLE_NAME *hash_table,
+                          struct bucket_array *old) {
+  atomic_store(&hash_table->old_buckets, NULL);
+  lock(&hash_table->resize_lock);
+  old->retired_epoch = hash_table_epoch_current(&hash_table->epoch);
+  old->retired = hash_table->retired;
+  hash_table->retired = old;
+  reclaim_arrays(hash_table);
+  unlock(&hash_table->resize_lock);
+}
+
+// Copies one bucket of old into the next array and forwards it. The caller
+// holds the bucket's stripe lock, which also covers both destination buckets.
+// Nodes are copied rather than relinked so that a reader part way down the
+// old chain is never carried into the other destination bucket. The originals
+// are then retired, since nothing follows a forwarded head except readers
+// that were already on the chain.
+static void migrate_bucket(struct HASH_TABLE_NAME *hash_table,
+                           struct bucket_array *old, size_t index) {
+  struct list_head *list_head = &old->buckets[index];
+  struct list_entry *first = SLIST_FIRST(list_head);
+  if (is_forwarded(first)) {
+    return;
+  }
+
+  struct bucket_array *next = atomic_load(&old->next);
+  struct lock_stripe *stripe = get_lock_stripe(hash_table, index);
+  if (stripe->retired_count > 0) {
+    reclaim(hash_table, stripe);
+  }
+  struct list_entry *list_entry = NULL;
+  for (list_entry = first; list_entry != NULL;
+       list_entry = SLIST_NEXT(list_entry, pointers)) {
+    struct list_entry *copy = hash_table_slab_alloc(&stripe->slab);
+    *copy = *list_entry;
+    hash_table_bloom_add(&next->bloom, copy->hash);
+    publish_head(get_bucket(next, copy->hash), copy);
+  }
+  // Released after the copies, so a reader that sees the tag sees them too.
+  __atomic_store_n(&SLIST_FIRST(list_head),
+                   (struct list_entry *)((uintptr_t)first | FORWARDED_TAG),
+                   __ATOMIC_RELEASE);
+  for (list_entry = first; list_entry != NULL;
+       list_entry = SLIST_NEXT(list_entry, pointers)) {
+    retire(hash_table, stripe, list_entry);
+  }
+
+  if (atomic_fetch_add(&old->migrated, 1) + 1 == old->capacity) {
+    finish_resize(hash_table, old);
+  }
+}
+
+// Allocates a bucket array twice the size of full and makes it current. The
+// old array is then drained a few buckets at a time by writers, so no writer
+// ever waits on the whole table being rehashed.
+static void start_resize(struct HASH_TABLE_NAME *hash_table,
+                         struct bucket_array *full) {
+  if (atomic_load(&hash_table->old_buckets) != NULL ||
+      pthread_mutex_trylock(&hash_table->resize_lock) != 0) {
+    return;
+  }
+  if (atomic_load(&hash_table->old_buckets) == NULL &&
+      atomic_load(&hash_table->buckets) == full) {
+    reclaim_arrays(hash_table);
+    struct bucket_array *next =
+        create_bucket_array(&hash_table->options, full->capacity * 2);
+    atomic_store(&full->next, next);
+    // Published before the new array so that anyone who sees the new array
+    // also sees that old buckets may still hold their keys.
+    atomic_store(&hash_table->old_buckets, full);
+    atomic_store(&hash_table->buckets, next);
+  }
+  unlock(&hash_table->resize_lock);
+}
+
+// Migrates MIGRATE_BATCH buckets for each of the caller's inserts.
+static void help_resize(struct HASH_TABLE_NAME *hash_table, size_t inserts) {
+  struct bucket_array *old = atomic_load(&hash_table->old_buckets);
+  if (old == NULL) {
+    return;
+  }
+  size_t batch = inserts * MIGRATE_BATCH;
+  size_t start = atomic_fetch_add(&old->migrate_cursor, batch);
+  for (size_t i = start; i < start + batch && i < old->capacity; ++i) {
+    struct lock_stripe *stripe = get_lock_stripe(hash_table, i);
+    acquire_stripe(stripe);
+    migrate_bucket(hash_table, old, i);
+    release_stripe_and_advance(hash_table, stripe);
+  }
+}
+
+// Returns the bucket for hash in the newest array, migrating the key's old
+// bucket (if any) into it first. The caller holds the key's stripe lock.
+static struct list_head *get_locked_bucket(struct HASH_TABLE_NAME *hash_table,
+                                           uint32_t hash,
+                                           struct bucket_array **array) {
+  while (true) {
+    struct bucket_array *buckets = atomic_load(&hash_table->buckets);
+    struct bucket_array *old = atomic_load(&hash_table->old_buckets);
+    if (old != NULL && old != buckets) {
+      migrate_bucket(hash_table, old, hash & (old->capacity - 1));
+    }
+    struct list_head *list_head = get_bucket(buckets, hash);
+    if (!is_forwarded(SLIST_FIRST(list_head))) {
+      *array = buckets;
+      return list_head;
+    }
+  }
+}
+
+// Returns the head of the chain currently holding hash. A key that has not
+// been migrated yet is still in the old array, otherwise forwarding is
+// followed to the array it was copied to.
+static struct list_entry *find_chain(struct HASH_TABLE_NAME *hash_table,
+                                     uint32_t hash) {
+  struct bucket_array *array = atomic_load(&hash_table->buckets);
+  struct bucket_array *old = atomic_load(&hash_table->old_buckets);
+  if (old != NULL) {
+    array = old;
+  }
+  while (true) {
+    struct list_entry *first = load_first(get_bucket(array, hash));
+    if (!is_forwarded(first)) {
+      return first;
+    }
+    array = atomic_load(&array->next);
+  }
+}
+
+// Arena chunks never move and are filled before the node that points into
+// them is published, so an unlocked reader can follow the offset.
+static const char *get_key(struct HASH_TABLE_NAME *hash_table,
+                           struct list_entry *list_entry) {
+  if (hash_table->options.own_keys) {
+    struct lock_stripe *stripe = get_lock_stripe(hash_table, list_entry->hash);
+    return hash_table_arena_get(&stripe->keys, list_entry->owned.offset);
+  }
+  return list_entry->key;
+}
+
+// Counts the nodes it compared into probes, if given.
+static struct list_entry *get_list_entry(struct HASH_TABLE_NAME *hash_table,
+                                         const char *key, uint32_t hash,
+                                         struct list_entry *first,
+                                         size_t *probes) {
+  assert(key != NULL);
+
+  size_t count = 0;
+  bool check_hash = !hash_table->options.skip_hash_check;
+  struct list_entry *entry = first;
+  for (; entry != NULL; entry = load_next(entry)) {
+    ++count;
+    if ((!check_hash || entry->hash == hash) &&
+        strcmp(get_key(hash_table, entry), key) == 0) {
+      break;
+    }
+  }
+  if (probes != NULL) {
+    *probes = count;
+  }
+  return entry;
+}
+
+static void record_lookup(struct HASH_TABLE_NAME *hash_table, uint32_t hash,
+                          size_t probes) {
+#ifdef HASH_TABLE_V2_STATS
+  struct lock_stripe *stripe = get_lock_stripe(hash_table, hash);
+  size_t bin = probes < HASH_TABLE_V2_PROBE_BINS ? probes
+                                                 : HASH_TABLE_V2_PROBE_BINS - 1;
+  atomic_fetch_add_explicit(&stripe->probe_histogram[bin], 1,
+                            memory_order_relaxed);
+#else
+  (void)hash_table;
+  (void)hash;
+  (void)probes;
+#endif
+}
+
+// Whether the filters let a lookup of hash through to the chains. A key is in
+// the filter of every array it has been published in, so one present when
+// buckets is loaded is in that array's filter, or in the one old_buckets
+// still points to if it has not been migrated yet. The caller is in an epoch
+// section.
+static bool filter_may_contain(struct HASH_TABLE_NAME *hash_table,
+                               uint32_t hash) {
+  struct bucket_array *array = atomic_load(&hash_table->buckets);
+  struct bucket_array *old = atomic_load(&hash_table->old_buckets);
+  return hash_table_bloom_may_contain(&array->bloom, hash) ||
+         (old != NULL && hash_table_bloom_may_contain(&old->bloom, hash));
+}
+
+bool HASH_TABLE_FN(contains)(struct HASH_TABLE_NAME *hash_table, const char *key) {
+  assert(key != NULL);
+  uint32_t hash = get_hash(hash_table, key);
+  struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+  if (!filter_may_contain(hash_table, hash)) {
+    hash_table_epoch_exit(record);
+    return false;
+  }
+  struct list_entry *first = find_chain(hash_table, hash);
+  size_t probes;
+  struct list_entry *list_entry =
+      get_list_entry(hash_table, key, hash, first, &probes);
+  hash_table_epoch_exit(record);
+  record_lookup(hash_table, hash, probes);
+  return list_entry != NULL;
+}
+
+// Whether the filter lets a lookup of key through to the chains, always true
+// without one. Lets callers measure the filter's false positives.
+bool HASH_TABLE_FN(bloom_may_contain)(struct HASH_TABLE_NAME *hash_table,
+                                      const char *key) {
+  assert(key != NULL);
+  uint32_t hash = get_hash(hash_table, key);
+  struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+  bool may_contain = filter_may_contain(hash_table, hash);
+  hash_table_epoch_exit(record);
+  return may_contain;
+}
+
+// With rcu, a published node never changes: an update links a copy holding
+// the new value in its place and retires the original, read-copy-update
+// style. The caller holds the stripe lock.
+static void replace_entry(struct HASH_TABLE_NAME *hash_table,
+                          struct lock_stripe *stripe,
+                          struct list_head *list_head,
+                          struct list_entry *list_entry,
+                          HASH_TABLE_VALUE value) {
+  if (stripe->retired_count > 0) {
+    reclaim(hash_table, stripe);
+  }
+  struct list_entry *copy = hash_table_slab_alloc(&stripe->slab);
+  *copy = *list_entry;
+  copy->value = value;
+  struct list_entry **link = &SLIST_FIRST(list_head);
+  while (*link != list_entry) {
+    link = &SLIST_NEXT(*link, pointers);
+  }
+  __atomic_store_n(link, copy, __ATOMIC_RELEASE);
+  retire(hash_table, stripe, list_entry);
+}
+
+// Copies out the value of a node an unlocked reader holds.
+static void load_value(struct HASH_TABLE_NAME *hash_table,
+                       struct list_entry *list_entry, HASH_TABLE_VALUE *value) {
+  if (hash_table->options.rcu) {
+    *value = list_entry->value;
+  } else {
+    __atomic_load(&list_entry->value, value, __ATOMIC_RELAXED);
+  }
+}
+
+// Adds or updates key with its stripe locked. Returns the bucket array if
+// this insert pushed it over the load factor, NULL otherwise.
+static struct bucket_array *insert_locked(struct HASH_TABLE_NAME *hash_table,
+                                          struct lock_stripe *stripe,
+                                          uint32_t hash, const char *key,
+                                          HASH_TABLE_VALUE value) {
+  assert(key != NULL);
+  struct bucket_array *array;
+  struct list_head *list_head = get_locked_bucket(hash_table, hash, &array);
+  struct list_entry *list_entry =
+      get_list_entry(hash_table, key, hash, SLIST_FIRST(list_head), NULL);
+
+  /* Update the value if it already exists */
+  if (list_entry != NULL) {
+    if (hash_table->options.rcu) {
+      replace_entry(hash_table, stripe, list_head, list_entry, value);
+    } else {
+      // Values too big for one instruction are stored and loaded through
+      // libatomic, so an unlocked reader never sees half of an update.
+      __atomic_store(&list_entry->value, &value, __ATOMIC_RELAXED);
+    }
+    return NULL;
+  }
+
+  // Reuse a removed node if readers have moved past it.
+  if (stripe->retired_count > 0) {
+    reclaim(hash_table, stripe);
+  }
+  list_entry = hash_table_slab_alloc(&stripe->slab);
+  if (hash_table->options.own_keys) {
+    list_entry->owned.length = strlen(key);
+    list_entry->owned.offset =
+        hash_table_arena_add(&stripe->keys, key, list_entry->owned.length);
+  } else {
+    list_entry->key = key;
+  }
+  list_entry->hash = hash;
+  list_entry->value = value;
+  // Before the node is published, so a reader that could find the node also
+  // finds its bits.
+  hash_table_bloom_add(&array->bloom, hash);
+  publish_head(list_head, list_entry);
+
+  // Every stripe covers the same share of buckets, so the load factor is
+  // estimated from the stripes instead of a counter shared by every writer.
+  ++stripe->size;
+  bool full = false;
+  double max_load_factor = hash_table->options.max_load_factor;
+  if (max_load_factor > 0 &&
+      (double)stripe->size * hash_table->stripe_count >
+          array->capacity * max_load_factor) {
+    if (stripe->overfull != array) {
+      stripe->overfull = array;
+      atomic_fetch_add(&array->overfull_stripes, 1);
+    }
+    full = atomic_load(&array->overfull_stripes) >=
+           hash_table->stripe_count / 2;
+  }
+  return full ? array : NULL;
+}
+
+void HASH_TABLE_FN(add_entry)(struct HASH_TABLE_NAME *hash_table, const char *key,
+                              HASH_TABLE_VALUE value) {
+  assert(key != NULL);
+  uint32_t hash = get_hash(hash_table, key);
+  struct lock_stripe *stripe = get_lock_stripe(hash_table, hash);
+  // Writers hold on to bucket arrays too, so they also keep retired ones from
+  // being freed under them.
+  struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+  acquire_stripe(stripe);
+  struct bucket_array *full = insert_locked(hash_table, stripe, hash, key, value);
+  release_stripe_and_advance(hash_table, stripe);
+
+  if (full != NULL) {
+    start_resize(hash_table, full);
+  }
+  help_resize(hash_table, 1);
+  hash_table_epoch_exit(record);
+}
+
+void HASH_TABLE_FN(add_entries)(struct HASH_TABLE_NAME *hash_table,
+                                const HASH_TABLE_PAIR *pairs,
+                                size_t count) {
+  size_t stripe_count = hash_table->stripe_count;
+  uint32_t *hashes = malloc(count * sizeof(uint32_t));
+  size_t *order = malloc(count * sizeof(size_t));
+  size_t *ends = calloc(stripe_count, sizeof(size_t));
+  assert(hashes != NULL && order != NULL && ends != NULL);
+
+  // Counting sort of the pairs by stripe. It is stable, so if a key appears
+  // more than once in the batch the last value still wins.
+  for (size_t i = 0; i < count; ++i) {
+    assert(pairs[i].key != NULL);
+    hashes[i] = get_hash(hash_table, pairs[i].key);
+    ++ends[hashes[i] & (stripe_count - 1)];
+  }
+  size_t total = 0;
+  for (size_t s = 0; s < stripe_count; ++s) {
+    size_t group = ends[s];
+    ends[s] = total;
+    total += group;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    order[ends[hashes[i] & (stripe_count - 1)]++] = i;
+  }
+
+  // Each stripe's group goes in under a single lock acquisition.
+  size_t begin = 0;
+  for (size_t s = 0; s < stripe_count; ++s) {
+    size_t end = ends[s];
+    if (begin == end) {
+      continue;
+    }
+    struct lock_stripe *stripe = &hash_table->stripes[s];
+    struct bucket_array *full = NULL;
+    struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+    acquire_stripe(stripe);
+    for (size_t i = begin; i < end; ++i) {
+      const HASH_TABLE_PAIR *pair = &pairs[order[i]];
+      struct bucket_array *array = insert_locked(
+          hash_table, stripe, hashes[order[i]], pair->key, pair->value);
+      if (array != NULL) {
+        full = array;
+      }
+    }
+    release_stripe_and_advance(hash_table, stripe);
+
+    if (full != NULL) {
+      start_resize(hash_table, full);
+    }
+    help_resize(hash_table, end - begin);
+    hash_table_epoch_exit(record);
+    begin = end;
+  }
+
+  free(ends);
+  free(order);
+  free(hashes);
+}
+
+HASH_TABLE_VALUE HASH_TABLE_FN(get_value)(struct HASH_TABLE_NAME *hash_table,
+                                          const char *key) {
+  assert(key != NULL);
+  uint32_t hash = get_hash(hash_table, key);
+  struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+  struct list_entry *first = find_chain(hash_table, hash);
+  size_t probes;
+  struct list_entry *list_entry =
+      get_list_entry(hash_table, key, hash, first, &probes);
+  assert(list_entry != NULL);
+  HASH_TABLE_VALUE value;
+  load_value(hash_table, list_entry, &value);
+  hash_table_epoch_exit(record);
+  record_lookup(hash_table, hash, probes);
+  return value;
+}
+
+bool HASH_TABLE_FN(remove)(struct HASH_TABLE_NAME *hash_table, const char *key) {
+  assert(key != NULL);
+  uint32_t hash = get_hash(hash_table, key);
+  struct lock_stripe *stripe = get_lock_stripe(hash_table, hash);
+  struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+  acquire_stripe(stripe);
+  struct bucket_array *array;
+  struct list_head *list_head = get_locked_bucket(hash_table, hash, &array);
+
+  bool check_hash = !hash_table->options.skip_hash_check;
+  struct list_entry *prev = NULL;
+  struct list_entry *list_entry = SLIST_FIRST(list_head);
+  while (list_entry != NULL &&
+         ((check_hash && list_entry->hash != hash) ||
+          strcmp(get_key(hash_table, list_entry), key) != 0)) {
+    prev = list_entry;
+    list_entry = SLIST_NEXT(list_entry, pointers);
+  }
+  if (list_entry == NULL) {
+    release_stripe_and_advance(hash_table, stripe);
+    hash_table_epoch_exit(record);
+    return false;
+  }
+
+  struct list_entry *next = SLIST_NEXT(list_entry, pointers);
+  if (prev == NULL) {
+    __atomic_store_n(&SLIST_FIRST(list_head), next, __ATOMIC_RELEASE);
+  } else {
+    __atomic_store_n(&SLIST_NEXT(prev, pointers), next, __ATOMIC_RELEASE);
+  }
+  --stripe->size;
+  // A stripe back under its share no longer votes for growing the array.
+  if (stripe->overfull == array &&
+      (double)stripe->size * hash_table->stripe_count <=
+          array->capacity * hash_table->options.max_load_factor) {
+    stripe->overfull = NULL;
+    atomic_fetch_sub(&array->overfull_stripes, 1);
+  }
+  retire(hash_table, stripe, list_entry);
+  reclaim(hash_table, stripe);
+  release_stripe_and_advance(hash_table, stripe);
+  hash_table_epoch_exit(record);
+  return true;
+}
+
+// Only meaningful while no writer is running. Buckets that have not been
+// migrated yet count as chains of their own.
+void HASH_TABLE_FN(chain_stats)(struct HASH_TABLE_NAME *hash_table,
+                                struct hash_table_chain_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  struct bucket_array *old = atomic_load(&hash_table->old_buckets);
+  struct bucket_array *buckets = atomic_load(&hash_table->buckets);
+  stats->buckets = buckets->capacity;
+
+  struct bucket_array *arrays[] = {old, buckets};
+  for (size_t a = 0; a < 2; ++a) {
+    if (arrays[a] == NULL) {
+      continue;
+    }
+    for (size_t i = 0; i < arrays[a]->capacity; ++i) {
+      struct list_head *list_head = &arrays[a]->buckets[i];
+      if (is_forwarded(SLIST_FIRST(list_head))) {
+        continue;
+      }
+      struct list_entry *list_entry = NULL;
+      size_t length = 0;
+      SLIST_FOREACH(list_entry, list_head, pointers) { ++length; }
+      if (length > 0) {
+        ++stats->used_buckets;
+      }
+      if (length > stats->max_length) {
+        stats->max_length = length;
+      }
+      stats->entries += length;
+    }
+  }
+}
+
+// Only meaningful while no writer is running.
+size_t HASH_TABLE_FN(allocations)(struct HASH_TABLE_NAME *hash_table) {
+  size_t allocations = 0;
+  for (size_t i = 0; i < hash_table->stripe_count; ++i) {
+    allocations += hash_table->stripes[i].slab.allocations;
+  }
+  return allocations;
+}
+
+// Only meaningful while no writer is running.
+void HASH_TABLE_FN(stats)(struct HASH_TABLE_NAME *hash_table,
+                          struct hash_table_v2_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  struct hash_table_chain_stats chain_stats;
+  HASH_TABLE_FN(chain_stats)(hash_table, &chain_stats);
+  stats->max_chain_length = chain_stats.max_length;
+
+#ifdef HASH_TABLE_V2_STATS
+  stats->enabled = true;
+  for (size_t i = 0; i < hash_table->stripe_count; ++i) {
+    struct lock_stripe *stripe = &hash_table->stripes[i];
+    stats->acquisitions += stripe->acquisitions;
+    stats->contended += stripe->contended;
+    stats->hold_nsec += stripe->hold_nsec;
+    for (size_t b = 0; b < HASH_TABLE_V2_PROBE_BINS; ++b) {
+      uint64_t count = atomic_load(&stripe->probe_histogram[b]);
+      stats->probe_histogram[b] += count;
+      stats->lookups += count;
+    }
+
+    // Insertion into the short list of hottest stripes.
+    size_t at = stats->hot_count;
+    while (at > 0 && stats->hot[at - 1].acquisitions < stripe->acquisitions) {
+      if (at < HASH_TABLE_V2_HOT_STRIPES) {
+        stats->hot[at] = stats->hot[at - 1];
+      }
+      --at;
+    }
+    if (at < HASH_TABLE_V2_HOT_STRIPES) {
+      stats->hot[at] = (struct hash_table_v2_stripe_stats){
+          .stripe = i,
+          .acquisitions = stripe->acquisitions,
+          .contended = stripe->contended,
+          .hold_nsec = stripe->hold_nsec};
+      if (stats->hot_count < HASH_TABLE_V2_HOT_STRIPES) {
+        ++stats->hot_count;
+      }
+    }
+  }
+#endif
+}
+
+// Only meaningful while no writer is running.
+size_t HASH_TABLE_FN(key_bytes)(struct HASH_TABLE_NAME *hash_table) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < hash_table->stripe_count; ++i) {
+    bytes += hash_table->stripes[i].keys.reserved;
+  }
+  return bytes;
+}
+
+// The oldest array that may still hold keys no newer array has. Every key
+// is reachable from it by following forwarded buckets. The caller is in an
+// epoch section.
+static struct bucket_array *get_oldest_array(struct HASH_TABLE_NAME *hash_table) {
+  struct bucket_array *array = atomic_load(&hash_table->buckets);
+  struct bucket_array *old = atomic_load(&hash_table->old_buckets);
+  return old != NULL ? old : array;
+}
+
+static size_t get_oldest_capacity(struct HASH_TABLE_NAME *hash_table) {
+  struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+  size_t capacity = get_oldest_array(hash_table)->capacity;
+  hash_table_epoch_exit(record);
+  return capacity;
+}
+
+static void init_cursor(struct HASH_TABLE_FN(cursor) *cursor,
+                        size_t array_capacity, size_t begin, size_t end) {
+  *cursor = (struct HASH_TABLE_FN(cursor)){
+      .array_capacity = array_capacity, .bucket = begin, .end = end};
+}
+
+// Copies every entry whose hash falls in bucket index of array into the
+// cursor. A forwarded bucket's keys are in two buckets of the next array,
+// index and index + capacity, which may be forwarded in turn.
+static void collect_bucket(struct HASH_TABLE_NAME *hash_table,
+                           struct HASH_TABLE_FN(cursor) *cursor,
+                           struct bucket_array *array, size_t index) {
+  struct list_entry *first = load_first(&array->buckets[index]);
+  if (is_forwarded(first)) {
+    struct bucket_array *next = atomic_load(&array->next);
+    collect_bucket(hash_table, cursor, next, index);
+    collect_bucket(hash_table, cursor, next, index + array->capacity);
+    return;
+  }
+  for (struct list_entry *list_entry = first; list_entry != NULL;
+       list_entry = load_next(list_entry)) {
+    if (cursor->count == cursor->capacity) {
+      cursor->capacity = cursor->capacity ? cursor->capacity * 2 : 16;
+      cursor->pairs =
+          realloc(cursor->pairs, cursor->capacity * sizeof(HASH_TABLE_PAIR));
+      assert(cursor->pairs != NULL);
+    }
+    HASH_TABLE_PAIR *pair = &cursor->pairs[cursor->count++];
+    pair->key = get_key(hash_table, list_entry);
+    load_value(hash_table, list_entry, &pair->value);
+  }
+}
+
+// Copies every entry whose hash falls in bucket index of an array of the
+// cursor's capacity. That array may have been freed since, but the oldest
+// array now is at least as large, and splits the bucket into every
+// capacity'th bucket from index.
+static void collect_cursor_bucket(struct HASH_TABLE_NAME *hash_table,
+                                  struct HASH_TABLE_FN(cursor) *cursor,
+                                  size_t index) {
+  struct bucket_array *array = get_oldest_array(hash_table);
+  for (size_t i = index; i < array->capacity; i += cursor->array_capacity) {
+    collect_bucket(hash_table, cursor, array, i);
+  }
+}
+
+// The cursor walks the buckets of the array that was oldest when it started,
+// so later resizes only split the buckets it has left, and never move a key
+// into one it has passed. A key that is in the table for the whole walk is
+// returned exactly once. One added or removed during the walk may or may not
+// be.
+void HASH_TABLE_FN(cursor_init)(struct HASH_TABLE_NAME *hash_table,
+                                struct HASH_TABLE_FN(cursor) *cursor) {
+  size_t capacity = get_oldest_capacity(hash_table);
+  init_cursor(cursor, capacity, 0, capacity);
+}
+
+// Moves to the next bucket holding any entries and copies them out, so the
+// caller may use the table while it goes through them. *pairs stays valid
+// until the next call. Returns false once every bucket has been visited.
+bool HASH_TABLE_FN(cursor_next)(struct HASH_TABLE_NAME *hash_table,
+                                struct HASH_TABLE_FN(cursor) *cursor,
+                                const HASH_TABLE_PAIR **pairs, size_t *count) {
+  cursor->count = 0;
+  struct epoch_record *record = hash_table_epoch_enter(&hash_table->epoch);
+  while (cursor->count == 0 && cursor->bucket < cursor->end) {
+    collect_cursor_bucket(hash_table, cursor, cursor->bucket++);
+  }
+  hash_table_epoch_exit(record);
+  *pairs = cursor->pairs;
+  *count = cursor->count;
+  return cursor->count > 0;
+}
+
+void HASH_TABLE_FN(cursor_destroy)(struct HASH_TABLE_FN(cursor) *cursor) {
+  free(cursor->pairs);
+}
+
+// One thread's share of a parallel for_each, part of parts.
+struct for_each_job {
+  pthread_t thread;
+  struct HASH_TABLE_NAME *hash_table;
+  size_t array_capacity;
+  size_t part;
+  size_t parts;
+  void (*visit)(const char *key, HASH_TABLE_VALUE value, size_t thread,
+                void *arg);
+  void *arg;
+};
+
+static void *for_each_part(void *arg) {
+  struct for_each_job *job = arg;
+  struct HASH_TABLE_FN(cursor) cursor;
+  size_t capacity = job->array_capacity;
+  init_cursor(&cursor, capacity, capacity * job->part / job->parts,
+              capacity * (job->part + 1) / job->parts);
+  const HASH_TABLE_PAIR *pairs;
+  size_t count;
+  while (HASH_TABLE_FN(cursor_next)(job->hash_table, &cursor, &pairs, &count)) {
+    for (size_t i = 0; i < count; ++i) {
+      job->visit(pairs[i].key, pairs[i].value, job->part, job->arg);
+    }
+  }
+  HASH_TABLE_FN(cursor_destroy)(&cursor);
+  return NULL;
+}
+
+// Calls visit on every entry, with the buckets split into one contiguous
+// range per thread. visit runs on every thread at once and is told which one
+// it is on, so bulk jobs can keep a partial result per thread. It gets the
+// same guarantees as a cursor, and may use the table.
+void HASH_TABLE_FN(for_each_parallel)(struct HASH_TABLE_NAME *hash_table,
+                                      size_t threads,
+                                      void (*visit)(const char *key,
+                                                    HASH_TABLE_VALUE value,
+                                                    size_t thread, void *arg),
+                                      void *arg) {
+  size_t array_capacity = get_oldest_capacity(hash_table);
+  if (threads == 0) {
+    threads = 1;
+  }
+  struct for_each_job *jobs = calloc(threads, sizeof(struct for_each_job));
+  assert(jobs != NULL);
+
+  // The calling thread takes the first part itself.
+  int ret;
+  for (size_t i = 0; i < threads; ++i) {
+    jobs[i] = (struct for_each_job){.hash_table = hash_table,
+                                    .array_capacity = array_capacity,
+                                    .part = i,
+                                    .parts = threads,
+                                    .visit = visit,
+                                    .arg = arg};
+    if (i > 0 &&
+        (ret = pthread_create(&jobs[i].thread, NULL, for_each_part, &jobs[i])) !=
+            0) {
+      exit(ret);
+    }
+  }
+  for_each_part(&jobs[0]);
+  for (size_t i = 1; i < threads; ++i) {
+    if ((ret = pthread_join(jobs[i].thread, NULL)) != 0) {
+      exit(ret);
+    }
+  }
+  free(jobs);
+}
+
+// The bucket arrays that may hold chains: the current one and the one being
+// migrated out of. Retired arrays only hold forwarded buckets.
+static size_t get_bucket_arrays(struct HASH_TABLE_NAME *hash_table,
+                                struct bucket_array ***arrays) {
+  size_t count = 1;
+  struct bucket_array *old = atomic_load(&hash_table->old_buckets);
+  count += old != NULL;
+  *arrays = malloc(count * sizeof(struct bucket_array *));
+  assert(*arrays != NULL);
+  size_t i = 0;
+  (*arrays)[i++] = atomic_load(&hash_table->buckets);
+  if (old != NULL) {
+    (*arrays)[i++] = old;
+  }
+  return count;
+}
+
+// One thread's share of releasing a table's memory, part of parts.
+struct release_job {
+  pthread_t thread;
+  struct HASH_TABLE_NAME *hash_table;
+  struct bucket_array **arrays;
+  size_t array_count;
+  size_t part;
+  size_t parts;
+};
+
+// Frees the nodes in this part's range of every bucket array, then the
+// slabs, arenas and retired nodes of this part's range of stripes. Slab
+// nodes are released together with their stripe's chunks, so only calloc'd
+// nodes have to be walked. A forwarded bucket's nodes were retired when it
+// moved, so its chain is skipped.
+static void *release_part(void *arg) {
+  struct release_job *job = arg;
+  struct HASH_TABLE_NAME *hash_table = job->hash_table;
+  bool free_nodes = !hash_table->options.slab;
+
+  for (size_t a = 0; a < job->array_count && free_nodes; ++a) {
+    struct bucket_array *array = job->arrays[a];
+    size_t begin = array->capacity * job->part / job->parts;
+    size_t end = array->capacity * (job->part + 1) / job->parts;
+    for (size_t i = begin; i < end; ++i) {
+      struct list_head *list_head = &array->buckets[i];
+      if (is_forwarded(SLIST_FIRST(list_head))) {
+        continue;
+      }
+      struct list_entry *list_entry = NULL;
+      while (!SLIST_EMPTY(list_head)) {
+        list_entry = SLIST_FIRST(list_head);
+        SLIST_REMOVE_HEAD(list_head, pointers);
+        free(list_entry);
+      }
+    }
+  }
+
+  size_t begin = hash_table->stripe_count * job->part / job->parts;
+  size_t end = hash_table->stripe_count * (job->part + 1) / job->parts;
+  for (size_t i = begin; i < end; ++i) {
+    struct lock_stripe *stripe = &hash_table->stripes[i];
+    // Retired nodes are no longer in any live chain.
+    for (size_t r = 0; r < stripe->retired_count && free_nodes; ++r) {
+      free(stripe->retired[r].list_entry);
+    }
+    free(stripe->retired);
+    hash_table_slab_destroy(&stripe->slab);
+    hash_table_arena_destroy(&stripe->keys);
+  }
+  return NULL;
+}
+
+// Frees every node, bucket array, slab and arena, split across threads. The
+// locks and the table itself are left alone. Returns the capacity of the
+// current bucket array.
+static size_t release(struct HASH_TABLE_NAME *hash_table, size_t threads) {
+  struct bucket_array **arrays;
+  size_t array_count = get_bucket_arrays(hash_table, &arrays);
+  size_t capacity = arrays[0]->capacity;
+  if (threads == 0) {
+    threads = 1;
+  }
+  struct release_job *jobs = calloc(threads, sizeof(struct release_job));
+  assert(jobs != NULL);
+
+  // The calling thread takes the first part itself.
+  int ret;
+  for (size_t i = 0; i < threads; ++i) {
+    jobs[i] = (struct release_job){.hash_table = hash_table,
+                                   .arrays = arrays,
+                                   .array_count = array_count,
+                                   .part = i,
+                                   .parts = threads};
+    if (i > 0 &&
+        (ret = pthread_create(&jobs[i].thread, NULL, release_part, &jobs[i])) !=
+            0) {
+      exit(ret);
+    }
+  }
+  release_part(&jobs[0]);
+  for (size_t i = 1; i < threads; ++i) {
+    if ((ret = pthread_join(jobs[i].thread, NULL)) != 0) {
+      exit(ret);
+    }
+  }
+
+  for (size_t a = 0; a < array_count; ++a) {
+    destroy_bucket_array(arrays[a]);
+  }
+  while (hash_table->retired != NULL) {
+    struct bucket_array *array = hash_table->retired;
+    hash_table->retired = array->retired;
+    destroy_bucket_array(array);
+  }
+  free(jobs);
+  free(arrays);
+  return capacity;
+}
+
+// No other thread may use the table while it is cleared. The bucket array
+// keeps its capacity, so refilling to the same size does not resize again.
+void HASH_TABLE_FN(clear)(struct HASH_TABLE_NAME *hash_table) {
+  size_t capacity = release(hash_table, 1);
+  for (size_t i = 0; i < hash_table->stripe_count; ++i) {
+    struct lock_stripe *stripe = &hash_table->stripes[i];
+    stripe->size = 0;
+    stripe->overfull = NULL;
+    stripe->retired = NULL;
+    stripe->retired_count = 0;
+    stripe->retired_capacity = 0;
+    stripe->advance_epoch = false;
+    hash_table_slab_init(&stripe->slab, sizeof(struct list_entry),
+                         hash_table->options.slab);
+    hash_table_arena_init(&stripe->keys);
+  }
+  atomic_store(&hash_table->old_buckets, NULL);
+  atomic_store(&hash_table->buckets,
+               create_bucket_array(&hash_table->options, capacity));
+}
+
+void HASH_TABLE_FN(destroy_parallel)(struct HASH_TABLE_NAME *hash_table,
+                                     size_t threads) {
+  release(hash_table, threads);
+
+  int ret;
+  for (size_t i = 0; i < hash_table->stripe_count; ++i) {
+    if ((ret = hash_table_lock_destroy(&hash_table->stripes[i].lock)) != 0) {
+      exit(ret);
+    }
+  }
+  free(hash_table->stripes);
+  if ((ret = pthread_mutex_destroy(&hash_table->resize_lock)) != 0) {
+    exit(ret);
+  }
+  hash_table_epoch_destroy(&hash_table->epoch);
+  free(hash_table);
+}
+
+void HASH_TABLE_FN(destroy)(struct HASH_TABLE_NAME *hash_table) {
+  HASH_TABLE_FN(destroy_parallel)(hash_table, 1);
+}
+
+#undef HASH_TABLE_NAME
+#undef HASH_TABLE_VALUE
+#undef HASH_TABLE_PAIR
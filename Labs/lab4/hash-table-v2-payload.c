@@ -0,0 +1,6 @@
+#include "hash-table-values.h"
+
+#define HASH_TABLE_NAME hash_table_v2_payload
+#define HASH_TABLE_VALUE struct hash_table_payload
+#define HASH_TABLE_PAIR struct hash_table_payload_pair
+#include "hash-table-v2-impl.h"
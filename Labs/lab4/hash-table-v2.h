@@ -4,13 +4,36 @@
 
 #include <stdbool.h>
 
-struct hash_table_v2;
-struct hash_table_v2 *hash_table_v2_create();
-void hash_table_v2_add_entry(struct hash_table_v2 *hash_table,
-                             const char *key,
-                             uint32_t value);
-bool hash_table_v2_contains(struct hash_table_v2 *hash_table,
-                            const char *key);
-uint32_t hash_table_v2_get_value(struct hash_table_v2 *hash_table,
-                                 const char* key);
-void hash_table_v2_destroy(struct hash_table_v2 *hash_table);
+// Lookups are binned by how many nodes they compared, the last bin also
+// counts every longer one.
+#define HASH_TABLE_V2_PROBE_BINS 16
+#define HASH_TABLE_V2_HOT_STRIPES 8
+
+struct hash_table_v2_stripe_stats {
+  size_t stripe;
+  uint64_t acquisitions;
+  uint64_t contended;
+  uint64_t hold_nsec;
+};
+
+// Lock and lookup counters are only kept when built with
+// -DHASH_TABLE_V2_STATS (make STATS=1), otherwise enabled is false and only
+// max_chain_length is filled in.
+struct hash_table_v2_stats {
+  bool enabled;
+  uint64_t acquisitions;
+  // Acquisitions where the first trylock failed.
+  uint64_t contended;
+  uint64_t hold_nsec;
+  uint64_t lookups;
+  size_t max_chain_length;
+  uint64_t probe_histogram[HASH_TABLE_V2_PROBE_BINS];
+  // Stripes with the most acquisitions, most first.
+  struct hash_table_v2_stripe_stats hot[HASH_TABLE_V2_HOT_STRIPES];
+  size_t hot_count;
+};
+
+#define HASH_TABLE_NAME hash_table_v2
+#define HASH_TABLE_VALUE uint32_t
+#define HASH_TABLE_PAIR struct hash_table_pair
+#include "hash-table-v2-decl.h"
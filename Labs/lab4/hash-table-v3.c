@@ -0,0 +1,200 @@
+#include "hash-table-v3.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Keys up to 7 characters (plus the terminator) live inside the slot itself;
+   longer keys fall back to the caller's pointer. */
+#define INLINE_KEY_SIZE 8
+
+/* The low two bits of a slot's tag say what is stored in it, the upper 30 bits
+   are the key's hash. A tag of zero is an empty slot. */
+#define SLOT_EMPTY 0
+#define SLOT_INLINE 1
+#define SLOT_POINTER 2
+#define SLOT_KIND_MASK 3
+
+struct slot {
+	uint32_t tag;
+	uint32_t value;
+	union {
+		char bytes[INLINE_KEY_SIZE];
+		const char *pointer;
+	} key;
+};
+
+struct hash_table_v3 {
+	struct slot *slots;
+	size_t capacity;
+	size_t size;
+	uint32_t shift;
+	/* Only hash_function applies, v3 always grows and has no nodes */
+	struct hash_table_options options;
+};
+
+/* A key prepared once per operation so every probe is a tag compare followed
+   by at most one 8 byte compare. */
+struct probe_key {
+	const char *key;
+	uint32_t tag;
+	char bytes[INLINE_KEY_SIZE];
+};
+
+static uint32_t get_shift(size_t capacity)
+{
+	uint32_t shift = 32;
+	while (capacity > 1) {
+		capacity >>= 1;
+		--shift;
+	}
+	return shift;
+}
+
+static void init_slots(struct hash_table_v3 *hash_table, size_t capacity)
+{
+	hash_table->slots = calloc(capacity, sizeof(struct slot));
+	assert(hash_table->slots != NULL);
+	hash_table->capacity = capacity;
+	hash_table->shift = get_shift(capacity);
+}
+
+struct hash_table_v3 *hash_table_v3_create_with_options(const struct hash_table_options *options)
+{
+	struct hash_table_v3 *hash_table = calloc(1, sizeof(struct hash_table_v3));
+	assert(hash_table != NULL);
+	init_slots(hash_table, HASH_TABLE_CAPACITY);
+	hash_table->options = *options;
+	return hash_table;
+}
+
+struct hash_table_v3 *hash_table_v3_create()
+{
+	return hash_table_v3_create_with_options(&hash_table_default_options);
+}
+
+static void make_probe_key(struct hash_table_v3 *hash_table,
+                           struct probe_key *probe,
+                           const char *key)
+{
+	assert(key != NULL);
+	size_t length = strnlen(key, INLINE_KEY_SIZE);
+	uint32_t hash = hash_table_hash(hash_table->options.hash_function, key);
+	probe->key = key;
+	memset(probe->bytes, 0, INLINE_KEY_SIZE);
+	if (length < INLINE_KEY_SIZE) {
+		memcpy(probe->bytes, key, length);
+		probe->tag = (hash << 2) | SLOT_INLINE;
+	}
+	else {
+		probe->tag = (hash << 2) | SLOT_POINTER;
+	}
+}
+
+static size_t get_index(struct hash_table_v3 *hash_table, uint32_t tag)
+{
+	/* Fibonacci hashing, bernstein_hash alone clusters badly under linear
+	   probing because its low bits barely depend on the early characters */
+	return (uint32_t) ((tag >> 2) * 2654435769u) >> hash_table->shift;
+}
+
+static struct slot *get_slot(struct hash_table_v3 *hash_table,
+                             struct probe_key *probe)
+{
+	size_t mask = hash_table->capacity - 1;
+	size_t index = get_index(hash_table, probe->tag);
+	while (true) {
+		struct slot *slot = &hash_table->slots[index];
+		if (slot->tag == SLOT_EMPTY) {
+			return slot;
+		}
+		if (slot->tag == probe->tag) {
+			if ((slot->tag & SLOT_KIND_MASK) == SLOT_INLINE) {
+				if (memcmp(slot->key.bytes, probe->bytes, INLINE_KEY_SIZE) == 0) {
+					return slot;
+				}
+			}
+			else if (strcmp(slot->key.pointer, probe->key) == 0) {
+				return slot;
+			}
+		}
+		index = (index + 1) & mask;
+	}
+}
+
+static void grow(struct hash_table_v3 *hash_table)
+{
+	struct slot *old_slots = hash_table->slots;
+	size_t old_capacity = hash_table->capacity;
+	init_slots(hash_table, old_capacity * 2);
+
+	size_t mask = hash_table->capacity - 1;
+	for (size_t i = 0; i < old_capacity; ++i) {
+		struct slot *old_slot = &old_slots[i];
+		if (old_slot->tag == SLOT_EMPTY) {
+			continue;
+		}
+		/* Keys are unique, so only an empty slot has to be found */
+		size_t index = get_index(hash_table, old_slot->tag);
+		while (hash_table->slots[index].tag != SLOT_EMPTY) {
+			index = (index + 1) & mask;
+		}
+		hash_table->slots[index] = *old_slot;
+	}
+	free(old_slots);
+}
+
+bool hash_table_v3_contains(struct hash_table_v3 *hash_table,
+                            const char *key)
+{
+	struct probe_key probe;
+	make_probe_key(hash_table, &probe, key);
+	return get_slot(hash_table, &probe)->tag != SLOT_EMPTY;
+}
+
+void hash_table_v3_add_entry(struct hash_table_v3 *hash_table,
+                             const char *key,
+                             uint32_t value)
+{
+	struct probe_key probe;
+	make_probe_key(hash_table, &probe, key);
+	struct slot *slot = get_slot(hash_table, &probe);
+
+	/* Update the value if it already exists */
+	if (slot->tag != SLOT_EMPTY) {
+		slot->value = value;
+		return;
+	}
+
+	/* Keep the load factor at or below 1/2 so probe sequences stay short */
+	if ((hash_table->size + 1) * 2 > hash_table->capacity) {
+		grow(hash_table);
+		slot = get_slot(hash_table, &probe);
+	}
+
+	slot->tag = probe.tag;
+	slot->value = value;
+	if ((probe.tag & SLOT_KIND_MASK) == SLOT_INLINE) {
+		memcpy(slot->key.bytes, probe.bytes, INLINE_KEY_SIZE);
+	}
+	else {
+		slot->key.pointer = key;
+	}
+	++hash_table->size;
+}
+
+uint32_t hash_table_v3_get_value(struct hash_table_v3 *hash_table,
+                                 const char *key)
+{
+	struct probe_key probe;
+	make_probe_key(hash_table, &probe, key);
+	struct slot *slot = get_slot(hash_table, &probe);
+	assert(slot->tag != SLOT_EMPTY);
+	return slot->value;
+}
+
+void hash_table_v3_destroy(struct hash_table_v3 *hash_table)
+{
+	free(hash_table->slots);
+	free(hash_table);
+}
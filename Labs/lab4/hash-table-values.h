@@ -0,0 +1,28 @@
+#pragma once
+
+#include "hash-table-base.h"
+#include "hash-table-v2.h"
+
+/* Bytes in the payload the _payload tables store inline, make PAYLOAD=N
+   changes it */
+#ifndef HASH_TABLE_PAYLOAD_BYTES
+#define HASH_TABLE_PAYLOAD_BYTES 64
+#endif
+
+struct hash_table_payload {
+	uint32_t bytes[HASH_TABLE_PAYLOAD_BYTES / sizeof(uint32_t)];
+};
+
+struct hash_table_payload_pair {
+	const char *key;
+	struct hash_table_payload value;
+};
+
+#define HASH_TABLE_NAME hash_table_base_payload
+#define HASH_TABLE_VALUE struct hash_table_payload
+#include "hash-table-base-decl.h"
+
+#define HASH_TABLE_NAME hash_table_v2_payload
+#define HASH_TABLE_VALUE struct hash_table_payload
+#define HASH_TABLE_PAIR struct hash_table_payload_pair
+#include "hash-table-v2-decl.h"
@@ -1,5 +1,9 @@
+import glob
+import os
 import re
+import shutil
 import subprocess
+import tempfile
 import unittest
 
 class TestLab3(unittest.TestCase):
@@ -77,4 +81,345 @@ class TestLab3(unittest.TestCase):
         self.assertEqual(miss_0, 0, msg=f"The missing entries for Hash table base should be 0 but got {miss_0} instead.")
         self.assertEqual(miss_1, 0, msg=f"The missing entries for Hash table v1 should be 0 but got {miss_1} instead.")
         self.assertEqual(miss_2, 0, msg=f"The missing entries for Hash table v2 should be 0 but got {miss_2} instead.")
-        
+
+    def test_4(self):
+        print("Running tester code 4...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--v3')).decode()
+        match = re.search(r'Hash table v3: ([\d\,]+) usec\n  - ([\d\,]+) missing\n', hash_result)
+        self.assertIsNotNone(match, msg="The tester did not report Hash table v3.")
+
+        miss_3 = int(match.group(2).replace(",", ""))
+        self.assertEqual(miss_3, 0, msg=f"The missing entries for Hash table v3 should be 0 but got {miss_3} instead.")
+
+    def test_5(self):
+        print("Running tester code 5...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '25000', '--mixed')).decode()
+        match = re.search(r'Hash table v2 mixed: ([\d\,]+) usec\n  - ([\d\,]+) failed lookups\n', hash_result)
+        self.assertIsNotNone(match, msg="The tester did not report the v2 mixed run.")
+
+        failed = int(match.group(2).replace(",", ""))
+        self.assertEqual(failed, 0, msg=f"Lookups during concurrent v2 inserts should all succeed but {failed} failed.")
+
+    def test_6(self):
+        print("Running tester code 6...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '25000', '--batch', '1000')).decode()
+        match = re.search(r'Hash table v2 batched \(([\d\,]+) per batch\): ([\d\,]+) usec\n  - ([\d\,]+) missing\n', hash_result)
+        self.assertIsNotNone(match, msg="The tester did not report the v2 batched run.")
+
+        miss = int(match.group(3).replace(",", ""))
+        self.assertEqual(miss, 0, msg=f"The missing entries for batched Hash table v2 should be 0 but got {miss} instead.")
+
+    def test_7(self):
+        print("Running benchmark code 7...")
+        self.assertTrue(self.make, msg='make failed')
+
+        result = subprocess.run(('./hash-table-bench', '-t', '2', '-n', '5000', '--runs', '2', '--warmup', '0', '--csv'),
+                                capture_output=True, text=True, check=True)
+        lines = result.stdout.strip().split('\n')
+        self.assertEqual(lines[0], 'table,hash,workload,threads,zipf,ops_per_sec,p50_nsec,p99_nsec,p999_nsec')
+
+        # base, v3 and cuckoo run with 1 thread, v1, v2, lockfree and cuckoo-concurrent with 1 and 2, each over 5 workloads
+        rows = [line.split(',') for line in lines[1:]]
+        self.assertEqual(len(rows), 55, msg=f"Expected 55 benchmark rows but got {len(rows)}.")
+        for row in rows:
+            p50, p99, p999 = int(row[6]), int(row[7]), int(row[8])
+            self.assertTrue(p50 <= p99 <= p999, msg=f"Percentiles out of order in {row}.")
+        self.assertEqual(result.stderr, '', msg=f"Some lookups returned the wrong result:\n{result.stderr}")
+
+    def test_8(self):
+        print("Running tester code 8...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--pin', '--first-touch')).decode()
+        match = re.search(r'Hash table base: ([\d\,]+) usec\n  - ([\d\,]+) missing\nHash table v1: ([\d\,]+) usec\n  - ([\d\,]+) missing\nHash table v2: ([\d\,]+) usec\n  - ([\d\,]+) missing\n', hash_result)
+        self.assertIsNotNone(match, msg="The tester did not report the pinned run.")
+
+        for group in (2, 4, 6):
+            miss = int(match.group(group).replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries with pinned, first-touch workers should be 0 but got {miss} instead.")
+
+    def test_9(self):
+        print("Running tester code 9...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--sharded')).decode()
+        for name in ('sharded federated', 'sharded merged', 'v2'):
+            match = re.search(rf'Hash table {name} lookup: ([\d\,]+) usec\n  - ([\d\,]+) missing\n', hash_result)
+            self.assertIsNotNone(match, msg=f"The tester did not report the {name} lookups.")
+
+            miss = int(match.group(2).replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for {name} lookups should be 0 but got {miss} instead.")
+
+    def test_10(self):
+        print("Running tester code 10...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '25000', '--churn')).decode()
+        match = re.search(r'Hash table v2 churn: ([\d\,]+) usec, ([\d\,]+) ops/sec\n  - ([\d\,]+) failed lookups\n  - ([\d\,]+) entries', hash_result)
+        self.assertIsNotNone(match, msg="The tester did not report the v2 churn run.")
+
+        failed = int(match.group(3).replace(",", ""))
+        self.assertEqual(failed, 0, msg=f"Lookups of just inserted keys during churn should all succeed but {failed} failed.")
+        entries = int(match.group(4).replace(",", ""))
+        self.assertLessEqual(entries, 8 * 12500, msg=f"Churn should leave at most half of every slice but left {entries} entries.")
+
+    def test_11(self):
+        print("Running tester code 11...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--clear')).decode()
+        matches = re.findall(r'Hash table v2 clear \((\w+)\): [\d\,]+ usec, [\d\,]+ usec fill, [\d\,]+ usec refill\n  - ([\d\,]+) missing\n', hash_result)
+        self.assertEqual(len(matches), 2, msg="The tester did not report clearing v2 with and without slabs.")
+
+        for name, miss in matches:
+            miss = int(miss.replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries after clearing and refilling v2 ({name}) should be 0 but got {miss} instead.")
+
+    def test_12(self):
+        print("Running tester code 12...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--lookups')).decode()
+        matches = re.findall(r'Hash table (\w+) lookups \(([\w ]+)\): [\d\,]+ usec, [\d\,]+ lookups/sec\n  - ([\d\,]+) (?:missing|found)\n', hash_result)
+        self.assertEqual(len(matches), 18, msg="The tester did not report three lookup phases for each of the six tables.")
+
+        for name, phase, failures in matches:
+            failures = int(failures.replace(",", ""))
+            self.assertEqual(failures, 0, msg=f"Hash table {name} lookups ({phase}) should have no failures but got {failures} instead.")
+
+    def test_13(self):
+        print("Running tester code 13...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '20000', '--key-length', '16-200', '--key-prefix', '24', '--lookups')).decode()
+        match = re.search(r'Hash table base: ([\d\,]+) usec\n  - ([\d\,]+) missing\nHash table v1: ([\d\,]+) usec\n  - ([\d\,]+) missing\nHash table v2: ([\d\,]+) usec\n  - ([\d\,]+) missing\n', hash_result)
+        self.assertIsNotNone(match, msg="The tester did not report the run with long keys.")
+        for group in (2, 4, 6):
+            miss = int(match.group(group).replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries with long, shared-prefix keys should be 0 but got {miss} instead.")
+
+        failures = re.findall(r'  - ([\d\,]+) found\n', hash_result)
+        self.assertEqual(len(failures), 6, msg="The tester did not report misses for each of the six tables.")
+        for found in failures:
+            self.assertEqual(int(found.replace(",", "")), 0, msg="Keys that were never inserted should not be found.")
+
+    def test_14(self):
+        print("Running tester code 14...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '25000', '--cuckoo')).decode()
+        matches = re.findall(r'Hash table (cuckoo(?: concurrent)?): [\d\,]+ usec\n  - ([\d\,]+) missing\n  - [\d\,]+ stashed\n', hash_result)
+        self.assertEqual(len(matches), 2, msg="The tester did not report the single threaded and concurrent cuckoo runs.")
+
+        for name, miss in matches:
+            miss = int(miss.replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for Hash table {name} should be 0 but got {miss} instead.")
+
+    def test_15(self):
+        print("Running tester code 15...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--values')).decode()
+        matches = re.findall(r'Hash table (base|v2) \(([^)]+)\): [\d\,]+ usec insert, [\d\,]+ usec lookup\n  - ([\d\,]+) wrong\n', hash_result)
+        self.assertEqual(len(matches), 6, msg="The tester did not report every value layout for base and v2.")
+
+        for name, layout, wrong in matches:
+            wrong = int(wrong.replace(",", ""))
+            self.assertEqual(wrong, 0, msg=f"The wrong values for Hash table {name} ({layout}) should be 0 but got {wrong} instead.")
+
+    def test_16(self):
+        print("Running tester code 16...")
+        self.assertTrue(self.make, msg='make failed')
+
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, 'base.snapshot')
+            hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--snapshot', path)).decode()
+        entries = re.findall(r'Hash table base load: [\d\,]+ usec, ([\d\,]+) entries\n', hash_result)
+        self.assertEqual([int(entry.replace(",", "")) for entry in entries], [100000], msg="The tester did not load every entry from the snapshot.")
+        matches = re.findall(r'Hash table base snapshot lookups \((first|second)\): [\d\,]+ usec\n  - ([\d\,]+) missing\n', hash_result)
+        self.assertEqual(len(matches), 2, msg="The tester did not report both snapshot lookup passes.")
+
+        for name, miss in matches:
+            miss = int(miss.replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for the {name} snapshot lookups should be 0 but got {miss} instead.")
+        wrong = re.search(r'  - ([\d\,]+) wrong values\n', hash_result)
+        self.assertIsNotNone(wrong, msg="The tester did not check the snapshot's values.")
+        wrong = int(wrong.group(1).replace(",", ""))
+        self.assertEqual(wrong, 0, msg=f"The snapshot returned {wrong} wrong values.")
+        corrupt = re.search(r'  - ([\d\,]+) of ([\d\,]+) corrupt snapshots rejected\n', hash_result)
+        self.assertIsNotNone(corrupt, msg="The tester did not try loading corrupt snapshots.")
+        self.assertEqual(corrupt.group(1), corrupt.group(2), msg=f"Only {corrupt.group(1)} of {corrupt.group(2)} corrupt snapshots failed to load.")
+
+    def test_17(self):
+        print("Running tester code 17...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '25000', '--iterate')).decode()
+        matches = re.findall(r'Hash table v2 (cursor \(during inserts\)|for_each \([\d\,]+ threads\)): [^\n]*\n  - ([\d\,]+) missing\n  - ([\d\,]+) duplicated\n', hash_result)
+        self.assertEqual(len(matches), 3, msg="The tester did not report the cursor and both for_each runs.")
+
+        for name, miss, duplicated in matches:
+            miss = int(miss.replace(",", ""))
+            duplicated = int(duplicated.replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for Hash table v2 {name} should be 0 but got {miss} instead.")
+            self.assertEqual(duplicated, 0, msg=f"The duplicated entries for Hash table v2 {name} should be 0 but got {duplicated} instead.")
+
+    def test_18(self):
+        print("Running tester code 18...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '10000', '--rcu')).decode()
+        matches = re.findall(r'Hash table (v2(?: payload)? \((?:rcu|locked updates)\)): [\d\,]+ usec, [\d\,]+ ops/sec\n  - ([\d\,]+) failed lookups\n', hash_result)
+        self.assertEqual(len(matches), 4, msg="The tester did not report v2 and v2 payload with and without rcu.")
+
+        for name, failed in matches:
+            failed = int(failed.replace(",", ""))
+            self.assertEqual(failed, 0, msg=f"The failed lookups for Hash table {name} should be 0 but got {failed} instead.")
+
+    def test_19(self):
+        print("Running tester code 19...")
+        self.assertTrue(self.make, msg='make failed')
+
+        for lock in ('mutex', 'ttas', 'mcs', 'futex'):
+            hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '10000', '--lock', lock, '--mixed')).decode()
+            matches = re.findall(r'Hash table v2: [\d\,]+ usec\n  - ([\d\,]+) missing\n', hash_result)
+            self.assertEqual(len(matches), 1, msg=f"The tester did not report v2 with the {lock} lock.")
+            miss = int(matches[0].replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for Hash table v2 with the {lock} lock should be 0 but got {miss} instead.")
+            failed = re.findall(r'Hash table v2 mixed: [\d\,]+ usec\n  - ([\d\,]+) failed lookups\n', hash_result)
+            self.assertEqual(len(failed), 1, msg=f"The tester did not report v2 mixed with the {lock} lock.")
+            failed = int(failed[0].replace(",", ""))
+            self.assertEqual(failed, 0, msg=f"The failed lookups for Hash table v2 mixed with the {lock} lock should be 0 but got {failed} instead.")
+
+    def test_20(self):
+        print("Running tester code 20...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '20000', '--misses')).decode()
+        for table in ('no filter', 'bloom filter'):
+            matches = re.findall(r'Hash table v2 misses \(' + table + r'\): [\d\,]+ usec.*\n  - ([\d\,]+) wrong\n', hash_result)
+            self.assertEqual(len(matches), 1, msg=f"The tester did not report v2 misses with {table}.")
+            wrong = int(matches[0].replace(",", ""))
+            self.assertEqual(wrong, 0, msg=f"The wrong lookups for Hash table v2 with {table} should be 0 but got {wrong} instead.")
+        rate = re.findall(r'  - ([\d\.]+)% false positives\n', hash_result)
+        self.assertEqual(len(rate), 1, msg="The tester did not report the false positive rate.")
+        self.assertLess(float(rate[0]), 5, msg=f"The false positive rate should be near 1% but got {rate[0]}% instead.")
+
+    def test_21(self):
+        print("Running tester code 21...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '10000', '--lockfree')).decode()
+        matches = re.findall(r'Hash table lockfree alternating: [\d\,]+ usec\n  - ([\d\,]+) missing\n  - ([\d\,]+) allocations\n', hash_result)
+        self.assertEqual(len(matches), 1, msg="The tester did not report the alternating lockfree tables.")
+        miss = int(matches[0][0].replace(",", ""))
+        self.assertEqual(miss, 0, msg=f"The missing entries for the alternating lockfree tables should be 0 but got {miss} instead.")
+        allocations = int(matches[0][1].replace(",", ""))
+        self.assertLess(allocations, 1000, msg=f"Alternating between two lockfree tables should reuse each thread's slabs but made {allocations} allocations.")
+
+    def test_22(self):
+        print("Running tester code 22...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '30000', '--chains')).decode()
+        stats = dict(re.findall(r'Chain lengths (.+?): ([\d\,]+) buckets', hash_result))
+        for name in ('base (fixed)', 'base (resized)', 'v2 (fixed)', 'v2 (resized)', 'v2 (half)', 'v2 (churned)'):
+            self.assertIn(name, stats, msg=f"The tester did not report chain lengths for {name}.")
+        buckets = {name: int(count.replace(",", "")) for name, count in stats.items()}
+        self.assertEqual(buckets['v2 (fixed)'], 4096, msg=f"v2 with growth disabled should keep 4096 buckets but has {buckets['v2 (fixed)']}.")
+        self.assertGreater(buckets['v2 (resized)'], 4096, msg="v2 with the default load factor should have grown.")
+        self.assertEqual(buckets['v2 (churned)'], buckets['v2 (half)'], msg=f"Churning at a constant size should not grow v2 past {buckets['v2 (half)']} buckets but it has {buckets['v2 (churned)']}.")
+
+    def test_23(self):
+        print("Running tester code 23...")
+        self.assertTrue(self.make, msg='make failed')
+
+        for hash_function in ('djb2', 'wyhash', 'crc32c'):
+            hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '20000', '--hash', hash_function)).decode()
+            for table in ('base', 'v1', 'v2'):
+                matches = re.findall(r'Hash table ' + table + r': [\d\,]+ usec\n  - ([\d\,]+) missing\n', hash_result)
+                self.assertEqual(len(matches), 1, msg=f"The tester did not report {table} with {hash_function}.")
+                miss = int(matches[0].replace(",", ""))
+                self.assertEqual(miss, 0, msg=f"The missing entries for Hash table {table} with {hash_function} should be 0 but got {miss} instead.")
+
+    def test_24(self):
+        print("Running tester code 24...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '10000', '--stripes')).decode()
+        matches = re.findall(r'Hash table v2 \(([\d\,]+) stripes\): [\d\,]+ usec, [\d\,]+ inserts/sec\n  - ([\d\,]+) missing\n', hash_result)
+        stripes = [int(count.replace(",", "")) for count, _ in matches]
+        self.assertEqual(stripes, [16, 64, 256, 1024, 4096], msg=f"The tester should report v2 with 16 to 4096 stripes but reported {stripes}.")
+        for count, miss in matches:
+            miss = int(miss.replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for Hash table v2 with {count} stripes should be 0 but got {miss} instead.")
+
+    def test_25(self):
+        print("Running tester code 25...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '8', '-s', '20000', '--slab')).decode()
+        allocations = {}
+        for table, allocator, count in re.findall(r'Hash table (\w+) \((calloc|slab)\): [\d\,]+ usec insert, [\d\,]+ usec destroy, ([\d\,]+) allocations\n', hash_result):
+            allocations[table, allocator] = int(count.replace(",", ""))
+        self.assertEqual(len(allocations), 6, msg="The tester should report base, v1 and v2 with calloc and with a slab.")
+        for table in ('base', 'v1'):
+            # Generated keys may repeat, so a few keys share a node.
+            self.assertGreater(allocations[table, 'calloc'], 8 * 20000 * 0.99, msg=f"Hash table {table} should calloc every node but made {allocations[table, 'calloc']} allocations.")
+            self.assertLess(allocations[table, 'slab'], 100, msg=f"Hash table {table} should allocate nodes in chunks but made {allocations[table, 'slab']} allocations.")
+        self.assertLess(allocations['v2', 'slab'], allocations['v2', 'calloc'] / 10, msg=f"Hash table v2 with a slab should make far fewer allocations than with calloc but made {allocations['v2', 'slab']} instead of {allocations['v2', 'calloc']}.")
+
+    def test_26(self):
+        print("Running tester code 26...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '10000', '--collisions')).decode()
+        for table in ('base', 'v2'):
+            matches = re.findall(r'Hash table ' + table + r' collisions: [\d\,]+ usec insert, [\d\,]+ usec lookup, against [\d\,]+ usec insert, [\d\,]+ usec lookup without the hash check\n  - ([\d\,]+) missing\n', hash_result)
+            self.assertEqual(len(matches), 1, msg=f"The tester did not report {table} collisions.")
+            miss = int(matches[0].replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for Hash table {table} with shared key prefixes should be 0 but got {miss} instead.")
+
+    def test_27(self):
+        print("Running tester code 27...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '10000', '--own-keys')).decode()
+        for table, keys in (('v2', 'borrowed'), ('base', 'owned'), ('v2', 'owned')):
+            matches = re.findall(r'Hash table ' + table + r' \(' + keys + r' keys\): [\d\,]+ usec insert, [\d\,]+ usec lookup, ([\d\,]+) key bytes\n  - ([\d\,]+) missing\n', hash_result)
+            self.assertEqual(len(matches), 1, msg=f"The tester did not report {table} with {keys} keys.")
+            key_bytes = int(matches[0][0].replace(",", ""))
+            self.assertGreaterEqual(key_bytes, 4 * 10000 * 8, msg=f"Hash table {table} with {keys} keys should hold at least 8 bytes per key but reported {key_bytes}.")
+            miss = int(matches[0][1].replace(",", ""))
+            self.assertEqual(miss, 0, msg=f"The missing entries for Hash table {table} with {keys} keys should be 0 but got {miss} instead.")
+
+    def test_28(self):
+        print("Running tester code 28...")
+        self.assertTrue(self.make, msg='make failed')
+
+        hash_result = subprocess.check_output(('./hash-table-tester', '-t', '4', '-s', '10000')).decode()
+        self.assertNotIn('lock acquisitions', hash_result, msg="The tester should only print stats when built with STATS=1.")
+
+        # A separate build, so the other tests keep the one without stats.
+        with tempfile.TemporaryDirectory() as directory:
+            for source in glob.glob('*.[ch]') + ['Makefile']:
+                shutil.copy(source, directory)
+            result = subprocess.run(['make', 'STATS=1', 'hash-table-tester'], cwd=directory, capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, msg='make STATS=1 failed')
+            hash_result = subprocess.check_output((os.path.join(directory, 'hash-table-tester'), '-t', '4', '-s', '10000')).decode()
+        match = re.search(r'Hash table v2: [\d\,]+ usec\n  - ([\d\,]+) missing\n  - ([\d\,]+) lock acquisitions, ([\d\,]+) contended \([\d\.]+%\), [\d\,]+ usec held, max chain ([\d\,]+)\n  - ([\d\,]+) lookups by nodes compared:(.*)\n  - hot stripes:', hash_result)
+        self.assertIsNotNone(match, msg="The tester built with STATS=1 did not print the v2 stats.")
+        miss, acquisitions, contended, max_chain, lookups = (int(match.group(i).replace(",", "")) for i in range(1, 6))
+        self.assertEqual(miss, 0, msg=f"The missing entries for Hash table v2 should be 0 but got {miss} instead.")
+        self.assertGreaterEqual(acquisitions, 4 * 10000, msg=f"Every insert takes a stripe lock, but only {acquisitions} acquisitions were counted.")
+        self.assertLessEqual(contended, acquisitions, msg=f"{contended} contended acquisitions is more than the {acquisitions} acquisitions.")
+        self.assertGreater(max_chain, 0, msg="The longest chain should hold at least one node.")
+        self.assertEqual(lookups, 4 * 10000, msg=f"The missing check looks up every key once, but {lookups} lookups were counted.")
+        histogram = sum(int(count.replace(",", "")) for count in re.findall(r' \d+\+?:([\d\,]+)', match.group(6)))
+        self.assertEqual(histogram, lookups, msg=f"The lookup histogram holds {histogram} lookups instead of {lookups}.")